@@ -0,0 +1,931 @@
+/**
+ * Headless benchmarks for glsf. Builds without GL and draws into a null
+ * recorder backend, so it runs anywhere:
+ *
+ *   cc -O2 -DGLSF_NO_GL bench/bench.c -o glsf_bench -lm -lpthread
+ *   ./glsf_bench <font> [cjk font] [filter]
+ *
+ * Every result is printed as one JSON object per line, for example
+ * {"bench":"raster","param":"size=12","value":81234.5,"unit":"glyphs/s"}
+ * Cases needing more glyphs than the font has print nothing.
+ */
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+#ifndef GLSF_NO_GL
+#define GLSF_NO_GL
+#endif
+#include "../glsf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define BENCH_MIN_TIME 0.25
+
+static const char* _bench_filter = NULL;
+
+// Keeps results alive so lookups are not optimized away.
+static volatile uint32_t _bench_sink;
+
+static const char* _bench_ascii =
+    "The quick brown fox jumps over the lazy dog. 0123456789 "
+    "Lorem ipsum dolor sit amet, consectetuer adipiscing elit.";
+
+static const char* _bench_cjk =
+    "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\xe3\x81\xae\xe6\x96\x87\xe7\xab\xa0"
+    "\xe3\x82\x92\xe8\xa1\xa8\xe7\xa4\xba\xe3\x81\x99\xe3\x82\x8b\xe3\x81\x9f"
+    "\xe3\x82\x81\xe3\x81\xae\xe3\x83\x86\xe3\x82\xb9\xe3\x83\x88\xe3\x81\xa7"
+    "\xe3\x81\x99\xe3\x80\x82\xe4\xb8\xad\xe6\x96\x87\xe5\xad\x97\xe7\xac\xa6"
+    "\xe5\x92\x8c\xed\x95\x9c\xea\xb5\xad\xec\x96\xb4\xe6\xbc\xa2\xe5\xad\x97";
+
+static const char* _bench_mixed =
+    "Chat: \xe3\x81\x93\xe3\x82\x93\xe3\x81\xab\xe3\x81\xa1\xe3\x81\xaf "
+    "world, \xe4\xbd\xa0\xe5\xa5\xbd 123 \xec\x95\x88\xeb\x85\x95 ok!";
+
+/**
+ * @fn benchNow
+ * @brief Monotonic time in seconds.
+ */
+static double benchNow()
+{
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
+}
+
+/**
+ * @fn benchEnabled
+ * @brief Whether a benchmark matches the filter given on command line.
+ */
+static int benchEnabled( const char* name )
+{
+    return !_bench_filter || strstr(name, _bench_filter) != NULL;
+}
+
+/**
+ * @fn benchReport
+ */
+static void benchReport( const char* bench, const char* param,
+                         double value, const char* unit )
+{
+    printf("{\"bench\":\"%s\",\"param\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+           bench, param, value, unit);
+    fflush(stdout);
+}
+
+/**
+ * @fn benchCreateFont
+ * @brief Creates a font drawing into a counting only recorder.
+ */
+static GLSFfont* benchCreateFont( const char* filename, float size,
+                                  const char* pre, GLSFrecorder* recorder )
+{
+    GLSFfont* font = glsfCreateFont(filename, size, "");
+    if(!font)
+        return NULL;
+
+    glsfInitRecorder(recorder, 0);
+    GLSFbackend backend = glsfRecorderBackend(recorder);
+    glsfSetBackend(font, &backend);
+
+    // Preload after switching backend so nothing goes to GL.
+    if(strlen(pre) > 0) {
+        float rect[4] = { 0, 0, 1e9f, 1e9f }, color[4] = { 1, 1, 1, 1 };
+        glsfEnqueueString(font, rect, color, pre);
+        font->batch.num_instances = 0;
+    }
+
+    return font;
+}
+
+/**
+ * @fn benchCodepoints
+ * @brief Collects up to max codepoints the font has glyphs for.
+ */
+static size_t benchCodepoints( GLSFfont* font, uint32_t* codepoints,
+                               size_t max )
+{
+    size_t count = 0;
+    uint32_t codepoint;
+    for(codepoint = 0x21; codepoint < 0x30000 && count < max; ++codepoint)
+        if(stbtt_FindGlyphIndex(&font->cache->face->info, codepoint) != 0)
+            codepoints[count++] = codepoint;
+    return count;
+}
+
+/**
+ * @fn benchRaster
+ * @brief Glyph rasterization throughput by pixel size.
+ */
+static void benchRaster( const char* filename )
+{
+    static const float sizes[] = { 8, 12, 18, 32, 64 };
+    uint32_t codepoint;
+    size_t i;
+
+    for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        GLSFrecorder recorder;
+        GLSFfont* font = benchCreateFont(filename, sizes[i], "", &recorder);
+        if(!font)
+            return;
+
+        GLSFglyph glyphs[128];
+        size_t num_glyphs = 0;
+        for(codepoint = 0x21; codepoint < 0x7f; ++codepoint)
+            if(glsfLoadGlyph(font, codepoint, &glyphs[num_glyphs]) == GL_TRUE)
+                num_glyphs++;
+
+        size_t count = 0;
+        double start = benchNow(), elapsed;
+        do {
+            size_t j;
+            for(j = 0; j < num_glyphs; ++j) {
+                GLSFbitmap bitmap;
+                if(glsfLoadBitmap(font, &glyphs[j], &bitmap) == GL_TRUE)
+                    glsfFreeBitmap(font, &bitmap);
+            }
+            count += num_glyphs;
+            elapsed = benchNow() - start;
+        } while(elapsed < BENCH_MIN_TIME);
+
+        char param[32];
+        sprintf(param, "size=%g", sizes[i]);
+        benchReport("raster", param, count / elapsed, "glyphs/s");
+
+        glsfDestroyFont(font);
+    }
+}
+
+/**
+ * @fn benchOversample
+ * @brief Glyph rasterization throughput at a small size by oversampling,
+ *        box filter included.
+ */
+static void benchOversample( const char* filename )
+{
+    static const uint32_t factors[][2] = { 
+        { 1, 1 }, { 2, 1 }, { 3, 1 }, { 2, 2 }, { 3, 3 } 
+    };
+    uint32_t codepoint;
+    size_t i;
+
+    for(i = 0; i < sizeof(factors) / sizeof(factors[0]); ++i) {
+        GLSFrecorder recorder;
+        GLSFfont* font = benchCreateFont(filename, 10, "", &recorder);
+        if(!font)
+            return;
+        glsfSetOversampling(font, factors[i][0], factors[i][1]);
+
+        GLSFglyph glyphs[128];
+        size_t num_glyphs = 0;
+        for(codepoint = 0x21; codepoint < 0x7f; ++codepoint)
+            if(glsfLoadGlyph(font, codepoint, &glyphs[num_glyphs]) == GL_TRUE)
+                num_glyphs++;
+
+        size_t count = 0;
+        double start = benchNow(), elapsed;
+        do {
+            size_t j;
+            for(j = 0; j < num_glyphs; ++j) {
+                GLSFbitmap bitmap;
+                if(glsfLoadBitmap(font, &glyphs[j], &bitmap) == GL_TRUE)
+                    glsfFreeBitmap(font, &bitmap);
+            }
+            count += num_glyphs;
+            elapsed = benchNow() - start;
+        } while(elapsed < BENCH_MIN_TIME);
+
+        char param[32];
+        sprintf(param, "%ux%u", factors[i][0], factors[i][1]);
+        benchReport("oversample", param, count / elapsed, "glyphs/s");
+
+        glsfDestroyFont(font);
+    }
+}
+
+/**
+ * @fn benchLayout
+ * @brief glsfEnqueueString throughput with all glyphs already loaded.
+ */
+static void benchLayoutText( const char* filename, const char* name,
+                             const char* text )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, text, &recorder);
+    if(!font)
+        return;
+
+    // Characters per iteration.
+    size_t num_chars = 0, i;
+    uint32_t state, codepoint;
+    for(state = UTF8_ACCEPT, i = 0; text[i]; ++i)
+        if(!decutf8(&state, &codepoint, (uint8_t)text[i]))
+            num_chars++;
+
+    float rect[4] = { 0, 0, 640, 480 }, color[4] = { 1, 1, 1, 1 };
+    size_t count = 0;
+    double start = benchNow(), elapsed;
+    do {
+        for(i = 0; i < 64; ++i)
+            glsfEnqueueString(font, rect, color, text);
+        glsfDrawFont(font);
+        count += 64 * num_chars;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+
+    benchReport("layout", name, count / elapsed, "chars/s");
+
+    glsfDestroyFont(font);
+}
+
+static void benchLayout( const char* filename, const char* cjk_filename )
+{
+    benchLayoutText(filename, "ascii", _bench_ascii);
+    benchLayoutText(cjk_filename, "cjk", _bench_cjk);
+    benchLayoutText(cjk_filename, "mixed", _bench_mixed);
+}
+
+/**
+ * @fn benchCull
+ * @brief Layout time of a long document scrolled to its middle, with and
+ *        without clipping to the viewport, and of one scrolled out of it.
+ */
+static void benchCullText( GLSFfont* font, const char* name, 
+                           const float rect[4], const char* text )
+{
+    float color[4] = { 1, 1, 1, 1 };
+    size_t count = 0;
+    double start = benchNow(), elapsed;
+    do {
+        glsfEnqueueString(font, rect, color, text);
+        _bench_sink += (uint32_t)font->batch.num_instances;
+        font->batch.num_instances = 0;
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+
+    benchReport("cull", name, elapsed / count * 1e6, "us");
+}
+
+static void benchCull( const char* filename )
+{
+    static const size_t num_lines = 1000;
+    size_t line_length = strlen(_bench_ascii) + 1, i;
+    char* text = (char*)malloc(num_lines * line_length + 1);
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!text || !font) {
+        free(text);
+        return;
+    }
+    for(i = 0; i < num_lines; ++i) {
+        memcpy(text + i * line_length, _bench_ascii, line_length - 1);
+        text[(i + 1) * line_length - 1] = '\n';
+    }
+    text[num_lines * line_length] = 0;
+
+    float viewport[4] = { 0, 0, 640, 480 };
+    float scrolled[4] = { 0, -(float)num_lines * 9, 640, 1e9f };
+    float below[4] = { 0, 1000, 640, 1e9f };
+    benchCullText(font, "lines=1000", scrolled, text);
+    glsfSetClip(font, viewport);
+    benchCullText(font, "lines=1000,clipped", scrolled, text);
+    benchCullText(font, "lines=1000,below", below, text);
+
+    glsfDestroyFont(font);
+    free(text);
+}
+
+/**
+ * @fn benchDocument
+ * @brief Frame time of a document scrolled smoothly and jumped around in
+ *        at random, for growing line counts, and the time to index it all.
+ */
+static void benchDocumentText( const char* filename, size_t num_lines )
+{
+    size_t line_length = strlen(_bench_ascii) + 1, i;
+    char* text = (char*)malloc(num_lines * line_length);
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!text || !font) {
+        free(text);
+        if(font)
+            glsfDestroyFont(font);
+        return;
+    }
+    for(i = 0; i < num_lines; ++i) {
+        memcpy(text + i * line_length, _bench_ascii, line_length - 1);
+        text[(i + 1) * line_length - 1] = '\n';
+    }
+    
+    // Lines wrap at a third of their width.
+    GLSFdocument document;
+    glsfInitDocument(&document, font, 240);
+    glsfAppendDocument(&document, text, num_lines * line_length);
+    
+    char name[64];
+    float color[4] = { 1, 1, 1, 1 };
+    float viewport[4] = { 0, 0, 640, 480 };
+    size_t count = 0;
+    double start = benchNow(), elapsed;
+    glsfIndexDocument(&document, (size_t)-1);
+    elapsed = benchNow() - start;
+    snprintf(name, sizeof(name), "lines=%u,index", (unsigned)num_lines);
+    benchReport("document", name, elapsed * 1e3, "ms");
+    
+    float height = (float)document.num_lines * glsfLoadCount(&font->cache->height);
+    start = benchNow();
+    do {
+        glsfClearRecorder(&recorder);
+        glsfDrawDocument(&document, viewport, color, (float)(count * 3 % 4096));
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    snprintf(name, sizeof(name), "lines=%u,scroll", (unsigned)num_lines);
+    benchReport("document", name, elapsed / count * 1e6, "us");
+    
+    count = 0;
+    start = benchNow();
+    do {
+        glsfClearRecorder(&recorder);
+        glsfDrawDocument(&document, viewport, color, (float)rand() / RAND_MAX * height);
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    snprintf(name, sizeof(name), "lines=%u,jump", (unsigned)num_lines);
+    benchReport("document", name, elapsed / count * 1e6, "us");
+    
+    glsfFreeDocument(&document);
+    glsfDestroyFont(font);
+    free(text);
+}
+
+static void benchDocument( const char* filename )
+{
+    benchDocumentText(filename, 1000);
+    benchDocumentText(filename, 100000);
+}
+
+/**
+ * @fn benchConsole
+ * @brief Lines appended per second to a console and the time to draw
+ *        it, against laying out the same lines again as one string.
+ */
+static void benchConsole( const char* filename )
+{
+    static const size_t num_lines = 1000;
+    size_t line_length = strlen(_bench_ascii) + 1, count = 0, i;
+    char* text = (char*)malloc(num_lines * line_length + 1);
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!text || !font) {
+        free(text);
+        if(font)
+            glsfDestroyFont(font);
+        return;
+    }
+    for(i = 0; i < num_lines; ++i) {
+        memcpy(text + i * line_length, _bench_ascii, line_length - 1);
+        text[(i + 1) * line_length - 1] = '\n';
+    }
+    text[num_lines * line_length] = 0;
+    
+    float color[4] = { 1, 1, 1, 1 };
+    float viewport[4] = { 0, 0, 640, 480 };
+    GLSFconsole console;
+    glsfInitConsole(&console, font, 640, num_lines, num_lines * line_length);
+    double start = benchNow(), elapsed;
+    do {
+        glsfAppendConsole(&console, color, _bench_ascii);
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("console", "append", count / elapsed, "lines/s");
+    
+    count = 0;
+    start = benchNow();
+    do {
+        glsfDrawConsole(&console, viewport);
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("console", "lines=1000,draw", elapsed / count * 1e6, "us");
+    
+    // The last lines moved to the bottom of the viewport.
+    float rect[4] = { 0, 480 - (float)num_lines * glsfLoadCount(&font->cache->height), 640, 1e9f };
+    count = 0;
+    start = benchNow();
+    do {
+        glsfDrawString(font, rect, color, text);
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("console", "lines=1000,string", elapsed / count * 1e6, "us");
+    
+    glsfFreeConsole(&console);
+    glsfDestroyFont(font);
+    free(text);
+}
+
+/**
+ * @fn benchEditor
+ * @brief Keystrokes in a 50k character editor, typed in one place and at
+ *        random, against laying out the whole text again.
+ */
+static void benchEditor( const char* filename )
+{
+    static const size_t length = 50000;
+    size_t line_length = strlen(_bench_ascii), count = 0, pos, i;
+    char* text = (char*)malloc(length + 1);
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!text || !font) {
+        free(text);
+        if(font)
+            glsfDestroyFont(font);
+        return;
+    }
+    for(i = 0; i < length; ++i)
+        text[i] = i % (line_length * 4) == 0 ? '\n' : _bench_ascii[i % line_length];
+    text[length] = 0;
+    
+    float color[4] = { 1, 1, 1, 1 };
+    float rect[4] = { 0, 0, 640, 1e9f };
+    GLSFeditor editor;
+    glsfInitEditor(&editor, font, 640, color);
+    glsfEditText(&editor, 0, 0, text, length);
+    
+    pos = length / 2;
+    double start = benchNow(), elapsed;
+    do {
+        glsfEditText(&editor, pos++, 0, count % 6 == 5 ? " " : "a", 1);
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("editor", "chars=50000,typing", elapsed / count * 1e6, "us");
+    
+    count = 0;
+    start = benchNow();
+    do {
+        pos = (size_t)rand() % editor.length;
+        glsfEditText(&editor, pos, 0, "a", 1);
+        glsfEditText(&editor, pos, 1, "", 0);
+        count += 2;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("editor", "chars=50000,random", elapsed / count * 1e6, "us");
+    
+    count = 0;
+    start = benchNow();
+    do {
+        glsfEnqueueString(font, rect, color, text);
+        font->batch.num_instances = 0;
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    benchReport("editor", "chars=50000,string", elapsed / count * 1e6, "us");
+    
+    glsfFreeEditor(&editor);
+    glsfDestroyFont(font);
+    free(text);
+}
+
+/**
+ * @fn benchImmediate
+ * @brief An immediate mode frame of 100 unchanged strings, laid out each
+ *        frame and copied from the batch's layout cache.
+ */
+static void benchImmediateFrame( GLSFfont* font, const char* name, 
+                                 uint32_t frames )
+{
+    float color[4] = { 1, 1, 1, 1 };
+    size_t count = 0, i;
+    glsfBatchCache(glsfGetBatch(), frames);
+    double start = benchNow(), elapsed;
+    do {
+        glsfBegin(font);
+        for(i = 0; i < 100; ++i) {
+            float rect[4] = { 10, 20.0f * i, 640, 20 };
+            glsfString(rect, color, _bench_ascii);
+        }
+        glsfEnd();
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    
+    benchReport("immediate", name, elapsed / count * 1e6, "us");
+    glsfBatchCache(glsfGetBatch(), 0);
+}
+
+static void benchImmediate( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!font)
+        return;
+    
+    benchImmediateFrame(font, "strings=100", 0);
+    benchImmediateFrame(font, "strings=100,cached", 60);
+    
+    glsfFreeBatch(glsfGetBatch());
+    glsfDestroyFont(font);
+}
+
+/**
+ * @fn benchVerticesBatch
+ * @brief Six vertices per glyph for the fixed function renderer, from a
+ *        batch of count glyphs already laid out.
+ */
+static void benchVerticesBatch( GLSFfont* font, size_t count )
+{
+    float color[4] = { 1, 1, 1, 1 };
+    size_t i;
+    font->batch.num_instances = 0;
+    for(i = 0; font->batch.num_instances < count; ++i) {
+        float rect[4] = { 10, 20.0f * (i % 50), 640, 20 };
+        glsfEnqueueString(font, rect, color, _bench_ascii);
+    }
+    glsfSyncFont(font);
+    
+    GLSFdraw draw;
+    memset(&draw, 0, sizeof(GLSFdraw));
+    draw.texture = &font->texture;
+    draw.instances = font->batch.instances;
+    draw.num_instances = count;
+    GLSFvertex* vertices = (GLSFvertex*)malloc(sizeof(GLSFvertex) * count * 6);
+    if(!vertices)
+        return;
+    
+    size_t frames = 0;
+    double start = benchNow(), elapsed;
+    do {
+        glsfExpandInstances(&draw, vertices);
+        _bench_sink += (uint32_t)vertices[frames % (count * 6)].x;
+        frames++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    
+    char param[32];
+    snprintf(param, sizeof(param), "glyphs=%u", (unsigned)count);
+    benchReport("vertices", param, frames * count / elapsed, "glyphs/s");
+    font->batch.num_instances = 0;
+    free(vertices);
+}
+
+static void benchVertices( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!font)
+        return;
+    
+    benchVerticesBatch(font, 128);
+    benchVerticesBatch(font, 65536);
+    
+    glsfDestroyFont(font);
+}
+
+/**
+ * @fn benchLoadGlyphs
+ * @brief Adds the given codepoints to a font in one update.
+ */
+static void benchLoadGlyphs( GLSFfont* font, const uint32_t* codepoints,
+                             size_t num_codepoints )
+{
+    GLSFglyph* glyphs = (GLSFglyph*)malloc(sizeof(GLSFglyph) * num_codepoints);
+    size_t num_glyphs = 0, i;
+    if(!glyphs)
+        return;
+    for(i = 0; i < num_codepoints; ++i)
+        if(glsfLoadGlyph(font, codepoints[i], &glyphs[num_glyphs]) == GL_TRUE)
+            num_glyphs++;
+    glsfUpdateFont(font, glyphs, num_glyphs);
+    glsfSyncFont(font);
+    free(glyphs);
+}
+
+/**
+ * @fn benchLookup
+ * @brief glsfGetGlyph hit latency as the number of loaded glyphs grows.
+ */
+static void benchLookup( const char* filename )
+{
+    static const size_t counts[] = { 64, 256, 1024, 4096 };
+    uint32_t* codepoints = (uint32_t*)malloc(sizeof(uint32_t) * 4096);
+    size_t i;
+    if(!codepoints)
+        return;
+
+    for(i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        GLSFrecorder recorder;
+        GLSFfont* font = benchCreateFont(filename, 12, "", &recorder);
+        if(!font)
+            break;
+
+        size_t num_codepoints = benchCodepoints(font, codepoints, counts[i]);
+        if(num_codepoints < counts[i]) {
+            glsfDestroyFont(font);
+            break;
+        }
+        benchLoadGlyphs(font, codepoints, num_codepoints);
+
+        size_t count = 0, j = 0;
+        uint32_t sum = 0;
+        double start = benchNow(), elapsed;
+        do {
+            size_t k;
+            for(k = 0; k < 1024; ++k) {
+                // Cheap scramble so lookups do not walk in insert order.
+                j = (j + 7919) % num_codepoints;
+                GLSFglyphrecord* glyph = glsfGetGlyph(font, codepoints[j]);
+                sum += glyph ? glyph->s : 0;
+            }
+            count += 1024;
+            elapsed = benchNow() - start;
+        } while(elapsed < BENCH_MIN_TIME);
+
+        char param[32];
+        sprintf(param, "glyphs=%u", (unsigned)num_codepoints);
+        benchReport("lookup", param, elapsed / count * 1e9, "ns");
+        _bench_sink = sum;
+        
+        // What layout walks per glyph: its record and its share of the
+        // current table.
+        GLSFcache* cache = font->cache;
+        size_t bytes = sizeof(GLSFglyphrecord) * cache->num_glyphs + 
+                       sizeof(cache->table->slots[0]) * (cache->table->mask + 1);
+        benchReport("lookup_bytes", param, (double)bytes / cache->num_glyphs, "bytes/glyph");
+
+        glsfDestroyFont(font);
+    }
+
+    free(codepoints);
+}
+
+/**
+ * @fn benchInsert
+ * @brief Cost of adding one new glyph to the atlas of a font already
+ *        holding some number of glyphs.
+ */
+static void benchInsert( const char* filename )
+{
+    static const size_t counts[] = { 64, 256, 1024 };
+    uint32_t* codepoints = (uint32_t*)malloc(sizeof(uint32_t) * (1024 + 16));
+    size_t i;
+    if(!codepoints)
+        return;
+
+    for(i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        GLSFrecorder recorder;
+        GLSFfont* font = benchCreateFont(filename, 12, "", &recorder);
+        if(!font)
+            break;
+
+        // Preload counts[i] glyphs and keep a few more for inserting.
+        size_t num_codepoints = benchCodepoints(font, codepoints, counts[i] + 16);
+        if(num_codepoints < counts[i] + 16) {
+            glsfDestroyFont(font);
+            break;
+        }
+        benchLoadGlyphs(font, codepoints, counts[i]);
+        size_t bytes = recorder.bytes_uploaded;
+
+        // Each insert followed by the upload a draw would do.
+        double start = benchNow();
+        size_t j;
+        for(j = counts[i]; j < num_codepoints; ++j) {
+            glsfGetGlyph(font, codepoints[j]);
+            glsfSyncFont(font);
+        }
+        double elapsed = benchNow() - start;
+
+        char param[32];
+        sprintf(param, "glyphs=%u", (unsigned)counts[i]);
+        benchReport("insert", param, elapsed / 16 * 1e6, "us");
+        benchReport("insert_upload", param, 
+                    (double)(recorder.bytes_uploaded - bytes) / 16, "bytes");
+
+        glsfDestroyFont(font);
+    }
+
+    free(codepoints);
+}
+
+/**
+ * @fn benchRestore
+ * @brief Rebuilding the texture of a font holding many glyphs after a
+ *        lost context, compared to creating the font again. Skipped for
+ *        fonts with fewer glyphs, run it with a CJK font.
+ */
+static void benchRestore( const char* filename )
+{
+    static const size_t num_glyphs = 4000;
+    uint32_t* codepoints = (uint32_t*)malloc(sizeof(uint32_t) * num_glyphs);
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, "", &recorder);
+    if(!codepoints || !font) {
+        free(codepoints);
+        if(font)
+            glsfDestroyFont(font);
+        return;
+    }
+
+    size_t num_codepoints = benchCodepoints(font, codepoints, num_glyphs);
+    if(num_codepoints < num_glyphs) {
+        glsfDestroyFont(font);
+        free(codepoints);
+        return;
+    }
+    char param[32];
+
+    // What recreating the font costs, rasterizing everything again.
+    double start = benchNow();
+    benchLoadGlyphs(font, codepoints, num_codepoints);
+    sprintf(param, "glyphs=%u,recreate", (unsigned)num_codepoints);
+    benchReport("restore", param, (benchNow() - start) * 1e3, "ms");
+
+    // Keep the pixels so the copy a driver would make is timed too.
+    GLSFrecorder uploads;
+    glsfInitRecorder(&uploads, GLSF_RECORD_UPLOADS);
+    GLSFbackend backend = glsfRecorderBackend(&uploads);
+    glsfSetBackend(font, &backend);
+
+    size_t count = 0, updates = 0;
+    double elapsed;
+    start = benchNow();
+    do {
+        glsfClearRecorder(&uploads);
+        glsfRestoreFont(font);
+        updates += uploads.num_updates;
+        count++;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+    sprintf(param, "glyphs=%u", (unsigned)num_codepoints);
+    benchReport("restore", param, elapsed / count * 1e3, "ms");
+    benchReport("restore_uploads", param, (double)updates / count, "calls");
+
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&uploads);
+    free(codepoints);
+}
+
+/**
+ * @fn benchSubpixel
+ * @brief Cost of small text placed at fractional positions: rasterized
+ *        at the pen, in subpixel phases, or at twice the size as if to be
+ *        scaled down. Atlas memory and texels filled per frame.
+ */
+static void benchSubpixelText( const char* filename, const char* name,
+                               float size, uint32_t phases )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, size, "", &recorder);
+    if(!font)
+        return;
+    glsfSetSubpixel(font, phases);
+
+    // One frame of lines, each starting a bit further right.
+    size_t num_chars = 0, i;
+    uint64_t texels = 0;
+    float color[4] = { 1, 1, 1, 1 };
+    for(i = 0; i < 64; ++i) {
+        float rect[4] = { i * 0.37f, i * size, 1e9f, 1e9f };
+        glsfEnqueueString(font, rect, color, _bench_ascii);
+        num_chars += strlen(_bench_ascii);
+    }
+    for(i = 0; i < font->batch.num_instances; ++i)
+        texels += font->batch.instances[i].w * font->batch.instances[i].h;
+    glsfDrawFont(font);
+
+    size_t count = 0;
+    double start = benchNow(), elapsed;
+    do {
+        for(i = 0; i < 64; ++i) {
+            float rect[4] = { i * 0.37f, i * size, 1e9f, 1e9f };
+            glsfEnqueueString(font, rect, color, _bench_ascii);
+        }
+        glsfDrawFont(font);
+        count += num_chars;
+        elapsed = benchNow() - start;
+    } while(elapsed < BENCH_MIN_TIME);
+
+    char param[32];
+    GLSFcache* cache = font->cache;
+    sprintf(param, "%s,atlas", name);
+    benchReport("subpixel", param, 
+                (double)cache->atlas_width * cache->atlas_used, "bytes");
+    sprintf(param, "%s,glyphs", name);
+    benchReport("subpixel", param, cache->stats.glyphs_rasterized, "glyphs");
+    sprintf(param, "%s,fill", name);
+    benchReport("subpixel", param, (double)texels, "texels");
+    sprintf(param, "%s,layout", name);
+    benchReport("subpixel", param, count / elapsed, "chars/s");
+
+    glsfDestroyFont(font);
+}
+
+static void benchSubpixel( const char* filename )
+{
+    benchSubpixelText(filename, "phases=1", 12, 1);
+    benchSubpixelText(filename, "phases=3", 12, 3);
+    benchSubpixelText(filename, "phases=4", 12, 4);
+    benchSubpixelText(filename, "2x", 24, 1);
+}
+
+/**
+ * @fn benchHitch
+ * @brief Frame time of drawing a string the first time, with none of its
+ *        glyphs loaded, compared to drawing it again. In async modes the
+ *        second frame may still be missing glyphs.
+ */
+static void benchHitchText( const char* filename, const char* name,
+                            const char* text, uint32_t mode )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = benchCreateFont(filename, 18, _bench_ascii, &recorder);
+    if(!font)
+        return;
+    if(glsfSetAsync(font, mode) == GL_FALSE) {
+        glsfDestroyFont(font);
+        return;
+    }
+
+    float rect[4] = { 0, 0, 640, 480 }, color[4] = { 1, 1, 1, 1 };
+
+    double start = benchNow();
+    glsfDrawString(font, rect, color, text);
+    double cold = benchNow() - start;
+
+    start = benchNow();
+    glsfDrawString(font, rect, color, text);
+    double warm = benchNow() - start;
+
+    char param[32];
+    sprintf(param, "%s,cold", name);
+    benchReport("hitch", param, cold * 1e6, "us");
+    sprintf(param, "%s,warm", name);
+    benchReport("hitch", param, warm * 1e6, "us");
+
+    glsfDestroyFont(font);
+}
+
+static void benchHitch( const char* filename, const char* cjk_filename )
+{
+    benchHitchText(filename, "ascii", "{|}~[]\\^_`@#$%&*<>", GLSF_ASYNC_BLOCK);
+    benchHitchText(cjk_filename, "cjk", _bench_cjk, GLSF_ASYNC_BLOCK);
+    benchHitchText(cjk_filename, "cjk_skip", _bench_cjk, GLSF_ASYNC_SKIP);
+    benchHitchText(cjk_filename, "cjk_tofu", _bench_cjk, GLSF_ASYNC_TOFU);
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc < 2 ) {
+        printf("Usage: glsf_bench <font> [cjk font] [filter]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* filename = argv[1];
+    const char* cjk_filename = argc > 2 ? argv[2] : argv[1];
+    _bench_filter = argc > 3 ? argv[3] : NULL;
+
+    if(benchEnabled("raster"))
+        benchRaster(filename);
+    if(benchEnabled("oversample"))
+        benchOversample(filename);
+    if(benchEnabled("layout"))
+        benchLayout(filename, cjk_filename);
+    if(benchEnabled("cull"))
+        benchCull(filename);
+    if(benchEnabled("document"))
+        benchDocument(filename);
+    if(benchEnabled("console"))
+        benchConsole(filename);
+    if(benchEnabled("editor"))
+        benchEditor(filename);
+    if(benchEnabled("immediate"))
+        benchImmediate(filename);
+    if(benchEnabled("vertices"))
+        benchVertices(filename);
+    if(benchEnabled("lookup"))
+        benchLookup(filename);
+    if(benchEnabled("insert"))
+        benchInsert(filename);
+    if(benchEnabled("restore"))
+        benchRestore(cjk_filename);
+    if(benchEnabled("subpixel"))
+        benchSubpixel(filename);
+    if(benchEnabled("hitch"))
+        benchHitch(filename, cjk_filename);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,101 @@
+/**
+ * Per-string overhead of the C++ wrapper, headless like bench.c:
+ *
+ *   c++ -std=c++17 -O2 -DGLSF_NO_GL bench/bench.cpp -o glsf_bench_cpp -lm -lpthread
+ *   ./glsf_bench_cpp <font>
+ *
+ * Compares building a std::vector<glsf::String> each frame, as
+ * Font::draw(const std::vector<String>&) needs, with drawing views of
+ * the same strings through Font::draw(Span<Text>). Results are printed
+ * as one JSON object per line like bench.c.
+ */
+#ifndef GLSF_NO_GL
+#define GLSF_NO_GL
+#endif
+#include "../glsf.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define BENCH_MIN_TIME 0.25
+
+static const char* _bench_words[] = {
+    "Score", "Health 100", "Ammo 30/120", "Player joined the game",
+    "The quick brown fox jumps over the lazy dog.", "FPS 60"
+};
+
+/**
+ * @fn benchReport
+ */
+static void benchReport( const char* bench, const char* param,
+                         double value, const char* unit )
+{
+    printf("{\"bench\":\"%s\",\"param\":\"%s\",\"value\":%.6g,\"unit\":\"%s\"}\n",
+           bench, param, value, unit);
+    fflush(stdout);
+}
+
+/**
+ * @fn benchStrings
+ * @brief Time per string of a frame of count strings through each API.
+ */
+static void benchStrings( glsf::Font& font, size_t count )
+{
+    std::vector<std::string> labels;
+    for( size_t i = 0; i < count; ++i )
+        labels.push_back(_bench_words[i % (sizeof(_bench_words) / sizeof(_bench_words[0]))]);
+    glsf::Color white(1, 1, 1, 1);
+    char param[64];
+    
+    // Callers of the vector API copy their strings into it every frame.
+    size_t frames = 0;
+    double start = glsfTime(), elapsed;
+    do {
+        std::vector<glsf::String> strings;
+        for( size_t i = 0; i < count; ++i )
+            strings.push_back(glsf::String(glsf::Rect(0, 20.0f * i, 640, 20), white,
+                                           labels[i].c_str()));
+        font.draw(strings);
+        frames++;
+        elapsed = glsfTime() - start;
+    } while( elapsed < BENCH_MIN_TIME );
+    snprintf(param, sizeof(param), "strings=%u,vector", (unsigned)count);
+    benchReport("cpp", param, elapsed / (frames * count) * 1e9, "ns");
+    
+    // Views are rebuilt each frame too, into storage kept across frames.
+    std::vector<glsf::Text> texts(count);
+    frames = 0;
+    start = glsfTime();
+    do {
+        for( size_t i = 0; i < count; ++i )
+            texts[i] = glsf::Text(glsf::Rect(0, 20.0f * i, 640, 20), white, labels[i]);
+        font.draw(texts);
+        frames++;
+        elapsed = glsfTime() - start;
+    } while( elapsed < BENCH_MIN_TIME );
+    snprintf(param, sizeof(param), "strings=%u,span", (unsigned)count);
+    benchReport("cpp", param, elapsed / (frames * count) * 1e9, "ns");
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc < 2 ) {
+        printf("Usage: glsf_bench_cpp <font>\n");
+        return EXIT_FAILURE;
+    }
+    
+    // Draw into a null recorder, counting only.
+    glsf::Font font(argv[1], 18, "");
+    GLSFrecorder recorder;
+    glsfInitRecorder(&recorder, 0);
+    GLSFbackend backend = glsfRecorderBackend(&recorder);
+    glsfSetBackend(font.handle(), &backend);
+    
+    benchStrings(font, 10);
+    benchStrings(font, 1000);
+    
+    glsfFreeBatch(glsfGetBatch());
+    glsfFreeRecorder(&recorder);
+    return EXIT_SUCCESS;
+}
@@ -24,9 +24,178 @@
 #ifndef __GLSF_H__
 #define __GLSF_H__
 
+#ifndef GLSF_NO_GL
 #include <GL/gl.h>
+#endif
+#include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(_WIN32) && !defined(_WINDOWS_)
+#include <windows.h>
+#endif
+
+// SSE2 is always there on x86-64. Define GLSF_NO_SIMD for plain C only.
+#if !defined(GLSF_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define GLSF_SSE2
+#include <emmintrin.h>
+#endif
+
+// Headless builds (GLSF_NO_GL) still use GL's boolean return values.
+#ifndef GL_TRUE
+#define GL_TRUE  1
+#define GL_FALSE 0
+#endif
+
+// GL 1.2, missing from headers stuck at 1.1. GL_CLAMP is gone from core
+// profiles.
+#if !defined(GLSF_NO_GL) && !defined(GL_CLAMP_TO_EDGE)
+#define GL_CLAMP_TO_EDGE 0x812F
+#endif
+
+/**
+ * Memory hooks. Everything a font allocates goes through the allocator
+ * given to glsfCreateFontEx, the glyph rasterizer included. Unset hooks
+ * (or a NULL allocator) mean malloc, realloc and free.
+ */
+typedef struct {
+    void* user;
+    void* (*alloc)( void*, size_t );
+    void* (*realloc)( void*, void*, size_t );
+    void  (*free)( void*, void* );
+} GLSFallocator;
+
+/**
+ * Bump allocator for buffers that only live while one glyph is being
+ * rasterized, freeing is a no-op and glsfResetArena reclaims everything.
+ * What does not fit comes from the allocator, and the arena grows to
+ * fit it on the next reset. Once warmed up it stops allocating. A
+ * passthrough arena only hands everything to its allocator, keeps no
+ * state and may be used by several threads at once.
+ */
+typedef struct {
+    GLSFallocator allocator;
+    uint8_t*      data;
+    size_t        size, used, wanted;
+    int32_t       passthrough;
+} GLSFarena;
+
+/**
+ * @fn glsfAlloc
+ */
+static void* glsfAlloc( const GLSFallocator* allocator, size_t size )
+{
+    if(allocator && allocator->alloc)
+        return allocator->alloc(allocator->user, size);
+    return malloc(size);
+}
+
+/**
+ * @fn glsfRealloc
+ */
+static void* glsfRealloc( const GLSFallocator* allocator, void* ptr, 
+                          size_t size )
+{
+    if(allocator && allocator->realloc)
+        return allocator->realloc(allocator->user, ptr, size);
+    return realloc(ptr, size);
+}
+
+/**
+ * @fn glsfFree
+ */
+static void glsfFree( const GLSFallocator* allocator, void* ptr )
+{
+    if(!ptr)
+        return;
+    if(allocator && allocator->free)
+        allocator->free(allocator->user, ptr);
+    else
+        free(ptr);
+}
+
+/**
+ * @fn glsfInitArena
+ * @brief An empty arena, the first glyph sizes it.
+ */
+static void glsfInitArena( GLSFarena* arena, const GLSFallocator* allocator )
+{
+    memset(arena, 0, sizeof(GLSFarena));
+    if(allocator)
+        arena->allocator = *allocator;
+}
+
+/**
+ * @fn glsfArenaAlloc
+ */
+static void* glsfArenaAlloc( GLSFarena* arena, size_t size )
+{
+    if(!arena)
+        return malloc(size);
+    if(arena->passthrough)
+        return glsfAlloc(&arena->allocator, size);
+    
+    size = (size + 15) & ~(size_t)15;
+    arena->wanted += size;
+    if(arena->used + size > arena->size)
+        return glsfAlloc(&arena->allocator, size);
+    
+    void* ptr = arena->data + arena->used;
+    arena->used += size;
+    return ptr;
+}
+
+/**
+ * @fn glsfArenaFree
+ */
+static void glsfArenaFree( GLSFarena* arena, void* ptr )
+{
+    if(!arena)
+        free(ptr);
+    else if(!ptr || (uint8_t*)ptr < arena->data || 
+            (uint8_t*)ptr >= arena->data + arena->size)
+        glsfFree(&arena->allocator, ptr);
+}
+
+/**
+ * @fn glsfResetArena
+ * @brief Reclaims everything, growing to fit what was asked for since
+ *        the last reset. Nothing allocated from it may still be in use.
+ */
+static void glsfResetArena( GLSFarena* arena )
+{
+    if(arena->wanted > arena->size) {
+        size_t size = arena->wanted + arena->wanted / 2;
+        uint8_t* data = (uint8_t*)glsfAlloc(&arena->allocator, size);
+        if(data) {
+            glsfFree(&arena->allocator, arena->data);
+            arena->data = data;
+            arena->size = size;
+        }
+    }
+    arena->used = arena->wanted = 0;
+}
+
+/**
+ * @fn glsfFreeArena
+ */
+static void glsfFreeArena( GLSFarena* arena )
+{
+    glsfFree(&arena->allocator, arena->data);
+    arena->data = NULL;
+    arena->size = arena->used = arena->wanted = 0;
+}
+
+// The rasterizer's temporary buffers come from the arena passed as its
+// userdata, see glsfRasterGlyph.
+#ifndef STBTT_malloc
+#define STBTT_malloc( x, u ) glsfArenaAlloc((GLSFarena*)(u), (x))
+#define STBTT_free( x, u )   glsfArenaFree((GLSFarena*)(u), (x))
+#endif
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include "stb_truetype.h"
@@ -37,9 +206,30 @@ typedef struct {
     uint32_t codepoint;
     int32_t  x0, y0, x1, y1;
     float    scale;
-    int32_t  index, advance, offset;
+    int32_t  index, advance;
+    int32_t  s, t;
+    int32_t  phase;
+    int32_t  pending;
 } GLSFglyph;
 
+/**
+ * A glyph as a cache keeps it, only what layout reads so that placing it
+ * touches one record of 24 bytes: its key, the pen advance in pixels,
+ * the quad's offset from the pen and size, and its texels in the atlas.
+ * Texel coordinates are exact in 16 bits and normalized when drawn,
+ * since the atlas grows. The glyph index and unscaled metrics are only
+ * needed to rasterize, they stay in the GLSFglyph it was loaded as.
+ * missing is set for codepoints the font lacks.
+ */
+typedef struct {
+    uint32_t codepoint;
+    float    advance;
+    int16_t  x0, y0;
+    uint16_t w, h;
+    uint16_t s, t;
+    uint8_t  phase, pending, missing;
+} GLSFglyphrecord;
+
 typedef struct {
     int32_t  width, height;
     uint8_t* data;
@@ -56,529 +246,4271 @@ typedef struct {
     float r, g, b, a;
 } GLSFvertex;
 
+/**
+ * A positioned glyph, one per drawn character. The shader renderer draws
+ * these directly as instances, the fixed function one expands them into
+ * six vertices each.
+ */
+typedef struct {
+    float    x, y;
+    uint16_t s, t, w, h;
+    uint8_t  color[4];
+} GLSFinstance;
+
+/**
+ * What is submitted to a backend for drawing: a run of instances using
+ * one texture, moved by offset pixels.
+ */
+typedef struct {
+    const GLSFtexture*  texture;
+    const GLSFinstance* instances;
+    size_t              num_instances;
+    float               offset[2];
+} GLSFdraw;
+
+/**
+ * An instance as a screen quad: corners in pixels with the draw's offset
+ * applied, y0 the top, and texture coordinates normalized to the
+ * texture's size. See glsfEmitQuads.
+ */
+typedef struct {
+    float   x0, y0, x1, y1;
+    float   u0, v0, u1, v1;
+    uint8_t color[4];
+} GLSFquad;
+
+/**
+ * Everything glsf asks of the graphics API. Textures are single channel
+ * 8-bit, updates give a row stride in bytes. The GL renderers are one
+ * implementation, the recorder another. Unset entries are skipped.
+ */
+typedef struct {
+    void*   user;
+    int32_t (*create_texture)( void*, GLSFtexture* );
+    void    (*update_texture)( void*, GLSFtexture*, int32_t, int32_t, 
+                               int32_t, int32_t, int32_t, const uint8_t* );
+    void    (*free_texture)( void*, GLSFtexture* );
+    void    (*draw)( void*, const GLSFdraw* );
+} GLSFbackend;
+
+/**
+ * Recorder flags.
+ * GLSF_RECORD_UPLOADS: Keep every texture update and a copy of its pixels.
+ * GLSF_RECORD_DRAWS: Keep every draw and a copy of its instances.
+ * Without flags the recorder is a null backend that only counts.
+ */
+#define GLSF_RECORD_UPLOADS 0x1
+#define GLSF_RECORD_DRAWS   0x2
+
+typedef struct {
+    uint32_t texture;
+    int32_t  x, y, width, height;
+    size_t   offset;
+} GLSFupload;
+
+typedef struct {
+    uint32_t texture;
+    int32_t  width, height;
+    size_t   offset, count;
+    float    translation[2];
+} GLSFsubmit;
+
+/**
+ * In-memory backend for tests and benchmarks without a GPU. Offsets in
+ * uploads and submits index its pixels and instances arrays, which are
+ * allocated through allocator, malloc unless set after glsfInitRecorder.
+ */
+typedef struct {
+    uint32_t      flags;
+    uint32_t      num_textures, last_name;
+    size_t        num_updates, num_draws;
+    size_t        bytes_uploaded, instances_drawn;
+    GLSFupload*   uploads;
+    size_t        num_uploads, max_uploads;
+    uint8_t*      pixels;
+    size_t        num_pixels, max_pixels;
+    GLSFsubmit*   submits;
+    size_t        num_submits, max_submits;
+    GLSFinstance* instances;
+    size_t        num_instances, max_instances;
+    GLSFallocator allocator;
+} GLSFrecorder;
+
+/**
+ * Per-font counters, collected unless GLSF_NO_STATS is defined. They add
+ * up until glsfResetStats, call it once per frame for per-frame numbers.
+ * One quad is emitted per drawn glyph, the fixed function renderer turns
+ * it into six vertices. Times are in seconds, layout excludes the time
+ * spent loading glyphs it missed. Culled glyphs are those skipped for
+ * being outside the batch's clip, lines skipped below it are not counted.
+ * Strings whose instances were copied from the batch's layout cache are
+ * counted as reused and their glyphs as quads emitted. Glyphs are
+ * rasterized once for all fonts sharing a cache, so those two counters
+ * are the cache's and only zeroed by glsfResetCacheStats.
+ */
+typedef struct {
+    uint32_t glyph_hits, glyph_misses;
+    uint32_t glyphs_rasterized;
+    uint64_t bytes_uploaded;
+    uint32_t texture_reallocs;
+    uint64_t quads_emitted;
+    uint32_t draw_calls;
+    uint32_t array_growths;
+    uint32_t glyphs_culled;
+    uint32_t layouts_reused;
+    double   raster_time, layout_time;
+} GLSFstats;
+
+#ifndef GLSF_NO_STATS
+#define GLSF_STAT_ADD( FONT, FIELD, N ) ((FONT)->stats.FIELD += (N))
+#define GLSF_STAT_TIME() glsfTime()
+#else
+#define GLSF_STAT_ADD( FONT, FIELD, N ) ((void)(N))
+#define GLSF_STAT_TIME() 0.0
+#endif
+
+/**
+ * Trace event passed to both begin and end callbacks. Name is the glsf
+ * function, fields not meaningful for it are zero. Bytes uploaded is only
+ * known by the end callback. Time is when it began for the begin callback
+ * and when it ended for the end one, from glsfTime. Work done holding a
+ * cache's lock is reported once it is released, so that callbacks may call
+ * back into glsf, and its time is then in the past.
+ */
+typedef struct {
+    const char* name;
+    uint32_t    codepoint;
+    uint32_t    num_glyphs;
+    uint64_t    bytes;
+    double      time;
+} GLSFtraceevent;
+
+/**
+ * User trace callbacks around glyph loads, rasterizing, uploads and
+ * draws, called on the thread doing the work. Compiled out with
+ * GLSF_NO_TRACE.
+ */
+typedef struct {
+    void* user;
+    void  (*begin)( void*, const GLSFtraceevent* );
+    void  (*end)( void*, const GLSFtraceevent* );
+} GLSFtrace;
+
+/**
+ * Writes trace events in Chrome's trace event JSON format, viewable in
+ * chrome://tracing or Perfetto, each on the thread that wrote it.
+ */
+typedef struct {
+    FILE*    file;
+    uint32_t pid;
+    int32_t  num_events;
+} GLSFchrometrace;
+
+#ifndef GLSF_NO_TRACE
+#define GLSF_TRACE( FONT, FN, EVENT ) \
+    do { if((FONT)->trace.FN) { (EVENT)->time = glsfTime(); \
+         (FONT)->trace.FN((FONT)->trace.user, (EVENT)); } } while(0)
+#else
+#define GLSF_TRACE( FONT, FN, EVENT ) ((void)(EVENT))
+#endif
+
+/**
+ * Atomics, a mutex and threads for glyph caches shared between threads.
+ * Defining GLSF_NO_THREADS turns them into plain accesses for single
+ * threaded use or compilers not covered here, and async loading off.
+ */
+#if defined(GLSF_NO_THREADS)
+typedef int32_t GLSFmutex;
+typedef int32_t GLSFcond;
+typedef int32_t GLSFthread;
+#define glsfInitMutex( M )    ((void)(M))
+#define glsfFreeMutex( M )    ((void)(M))
+#define glsfLockMutex( M )    ((void)(M))
+#define glsfUnlockMutex( M )  ((void)(M))
+#define glsfLoadPointer( P )        (*(P))
+#define glsfStorePointer( P, V )    (*(P) = (V))
+#define glsfLoadCount( P )          (*(P))
+#define glsfStoreCount( P, V )      (*(P) = (V))
+#define glsfAddCount( P, N )        (*(P) += (N))
+#define glsfThreadId()              1u
+#else
+#if defined(_WIN32)
+typedef CRITICAL_SECTION   GLSFmutex;
+typedef CONDITION_VARIABLE GLSFcond;
+typedef HANDLE             GLSFthread;
+#define glsfInitMutex( M )    InitializeCriticalSection(M)
+#define glsfFreeMutex( M )    DeleteCriticalSection(M)
+#define glsfLockMutex( M )    EnterCriticalSection(M)
+#define glsfUnlockMutex( M )  LeaveCriticalSection(M)
+#define glsfInitCond( C )     InitializeConditionVariable(C)
+#define glsfFreeCond( C )     ((void)(C))
+#define glsfWaitCond( C, M )  SleepConditionVariableCS((C), (M), INFINITE)
+#define glsfSignalCond( C )   WakeConditionVariable(C)
+#define GLSF_THREAD_FN( NAME, ARG ) static DWORD WINAPI NAME( LPVOID ARG )
+#define glsfStartThread( T, FN, ARG ) \
+    ((*(T) = CreateThread(NULL, 0, (FN), (ARG), 0, NULL)) != NULL)
+#define glsfJoinThread( T ) \
+    (WaitForSingleObject((T), INFINITE), CloseHandle(T))
+#define glsfThreadId()        ((uint32_t)GetCurrentThreadId())
+#else
+#include <pthread.h>
+typedef pthread_mutex_t GLSFmutex;
+typedef pthread_cond_t  GLSFcond;
+typedef pthread_t       GLSFthread;
+#define glsfInitMutex( M )    pthread_mutex_init((M), NULL)
+#define glsfFreeMutex( M )    pthread_mutex_destroy(M)
+#define glsfLockMutex( M )    pthread_mutex_lock(M)
+#define glsfUnlockMutex( M )  pthread_mutex_unlock(M)
+#define glsfInitCond( C )     pthread_cond_init((C), NULL)
+#define glsfFreeCond( C )     pthread_cond_destroy(C)
+#define glsfWaitCond( C, M )  pthread_cond_wait((C), (M))
+#define glsfSignalCond( C )   pthread_cond_signal(C)
+#define GLSF_THREAD_FN( NAME, ARG ) static void* NAME( void* ARG )
+#define glsfStartThread( T, FN, ARG ) \
+    (pthread_create((T), NULL, (FN), (ARG)) == 0)
+#define glsfJoinThread( T )   pthread_join((T), NULL)
+#define glsfThreadId()        ((uint32_t)(uintptr_t)pthread_self())
+#endif
+#if defined(__GNUC__) || defined(__clang__)
+#define glsfLoadPointer( P )        __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define glsfStorePointer( P, V )    __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#define glsfLoadCount( P )          __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define glsfStoreCount( P, V )      __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#define glsfAddCount( P, N )        __atomic_add_fetch((P), (N), __ATOMIC_ACQ_REL)
+#elif defined(_MSC_VER)
+#define glsfLoadPointer( P ) \
+    InterlockedCompareExchangePointer((PVOID volatile*)(P), NULL, NULL)
+#define glsfStorePointer( P, V ) \
+    InterlockedExchangePointer((PVOID volatile*)(P), (V))
+#define glsfLoadCount( P ) \
+    (uint32_t)InterlockedCompareExchange((LONG volatile*)(P), 0, 0)
+#define glsfStoreCount( P, V ) \
+    InterlockedExchange((LONG volatile*)(P), (LONG)(V))
+#define glsfAddCount( P, N ) \
+    (InterlockedExchangeAdd((LONG volatile*)(P), (LONG)(N)) + (N))
+#else
+#error "glsf: no atomics for this compiler, define GLSF_NO_THREADS"
+#endif
+#endif
+
+/**
+ * Open addressing table of glyph records by codepoint, at most half full.
+ * A slot holds a record's number plus one, zero when empty. Slots are
+ * never cleared, only filled or given a finished record in place of a
+ * pending one.
+ */
+typedef struct GLSFglyphtable {
+    uint32_t               mask;
+    uint32_t*              slots;
+    struct GLSFglyphtable* next;
+} GLSFglyphtable;
+
+#define GLSF_CHUNK_GLYPHS 256
+#define GLSF_MAX_CHUNKS   1024
+#define GLSF_MAX_DIRTY    8
+
+/**
+ * Tallest the atlas grows. Glyphs that do not fit once it is full are
+ * loaded blank, keeping their advance. Define it lower for backends with
+ * smaller textures, texel rows are kept in 16 bits so it is at most 65535.
+ */
+#ifndef GLSF_MAX_ATLAS_HEIGHT
+#define GLSF_MAX_ATLAS_HEIGHT 4096
+#endif
+
+/**
+ * A row of the atlas holding glyphs up to its height, filled left to
+ * right up to s.
+ */
+typedef struct {
+    int32_t t, height, s;
+} GLSFshelf;
+
+/**
+ * A glyph's decoded outline, kept by glyph index so that rasterizing it
+ * again in another phase or oversampling does not parse the font.
+ */
+typedef struct {
+    int32_t       num_vertices;
+    stbtt_vertex* vertices;
+} GLSFoutline;
+
+#define GLSF_OUTLINE_CHUNK 256
+
+/**
+ * A loaded font file, shared by the caches of every size made from it
+ * with glsfCreateFontFace. Only read once loaded, freed with the last
+ * reference. stbtt calls made on info directly allocate through the
+ * face's allocator, by its passthrough arena.
+ */
+typedef struct {
+    stbtt_fontinfo  info;
+    uint8_t*        data;
+    int32_t         ascent, descent, linegap;
+    int32_t         refs;
+    GLSFallocator   allocator;
+    GLSFarena       arena;
+} GLSFface;
+
+/**
+ * Glyphs of one font face at one size, shared by the fonts made from it
+ * with glsfCreateFontShared, typically one per GL context. A glyph is
+ * looked up and rasterized once, straight into a CPU copy of the atlas
+ * that each font's texture mirrors. The atlas is packed in shelves and
+ * only grows in height, up to GLSF_MAX_ATLAS_HEIGHT, so glyphs never
+ * move. Lookups take no lock: records are filled in under the mutex and
+ * then published with a release store. Records live in chunks and never
+ * move, replaced tables are kept until the cache is freed since readers
+ * may still be probing them. Codepoints the font lacks get a record with
+ * missing set so they are not looked up again. Subpixel variants of a
+ * glyph are records of their own, told apart by phase.
+ *
+ * Fonts in an async mode queue misses for the cache's rasterizer thread
+ * instead, leaving a pending record holding only metrics. The thread
+ * rasterizes outside the lock and publishes a finished record in its
+ * place. The queue keeps the loaded glyphs, with what rasterizing
+ * needs that records leave out.
+ */
+typedef struct {
+    GLSFface*       face;
+    float           size;
+    int32_t         oversample_x, oversample_y;
+    int32_t         refs;
+    GLSFallocator   allocator;
+    GLSFarena       arena, thread_arena;
+    GLSFmutex       mutex;
+    GLSFglyphtable* table;
+    GLSFglyphrecord* chunks[GLSF_MAX_CHUNKS];
+    uint32_t        num_glyphs;
+    uint32_t        height;
+    uint8_t*        pixels;
+    int32_t         atlas_width, atlas_height, atlas_used, atlas_full;
+    GLSFshelf*      shelves;
+    size_t          num_shelves, max_shelves;
+    GLSFoutline**   outlines[65536 / GLSF_OUTLINE_CHUNK];
+    GLSFstats       stats;
+    GLSFthread      thread;
+    GLSFcond        cond;
+    int32_t         running, quit;
+    GLSFglyph*      queue;
+    size_t          queue_head, num_queued, max_queued;
+    GLSFglyphrecord* tofu;
+} GLSFcache;
+
+/**
+ * What layout does with a glyph not loaded yet, see glsfSetAsync.
+ * GLSF_ASYNC_BLOCK: Load it right away, the default.
+ * GLSF_ASYNC_SKIP: Leave a gap as wide as its advance.
+ * GLSF_ASYNC_TOFU: Draw a box in its place.
+ * Either of the last two queues it for the rasterizer thread, the glyph
+ * shows up in a later frame.
+ */
+#define GLSF_ASYNC_BLOCK 0
+#define GLSF_ASYNC_SKIP  1
+#define GLSF_ASYNC_TOFU  2
+
+/**
+ * Most horizontal phases a glyph is rasterized in, see glsfSetSubpixel.
+ * A variant's phase is its shift in 64ths of a pixel, so fonts of one
+ * cache using different numbers of phases agree on what a record holds.
+ */
+#define GLSF_MAX_PHASES 8
+
+/**
+ * Most a glyph is oversampled each way, see glsfSetOversampling.
+ */
+#define GLSF_MAX_OVERSAMPLE 4
+
+#ifndef GLSF_NO_GL
+/**
+ * Render state flags.
+ * GLSF_STATE_OWNED: The caller promises that no one else touches the GL
+ * state glsf sets up (client arrays, blending, texturing, matrices and the
+ * bound texture). Redundant state changes are then skipped and nothing is
+ * restored after drawing. The viewport must be given with glsfSetViewport.
+ */
+#define GLSF_STATE_OWNED 0x1
+
+/**
+ * GLSF_STATE_SHADER: Draw with a GLSL 3.30 program and instanced quads
+ * instead of fixed function client arrays, works on core profiles.
+ * Requires GLSF_SHADER to be defined and GL 3.3 entry points declared
+ * (by a loader or GL_GLEXT_PROTOTYPES) before including glsf.h.
+ */
+#define GLSF_STATE_SHADER 0x2
+
+/**
+ * Per-context render state. Tracks what has already been set up so that
+ * drawing does not need to read back any GL state. Fonts drawing in the
+ * same context may share one with glsfSetState. Vertices for the fixed
+ * function renderer are allocated through allocator, malloc unless set
+ * after glsfInitState. GL_MAX_TEXTURE_SIZE is queried once, when the
+ * first texture is created, and kept in max_texture_size. A viewport not
+ * given with glsfSetViewport is read back on the first draw and kept.
+ */
+typedef struct {
+    uint32_t    flags;
+    int32_t     viewport[4], read_viewport;
+    int32_t     max_texture_size;
+    int32_t     valid, projected[2];
+    float       translated[2];
+    uint32_t    texture;
+    const void* pointer;
+    GLSFvertex* vertices;
+    size_t      max_vertices;
+    GLSFallocator allocator;
+#ifdef GLSF_SHADER
+    GLuint      program, vao, vbo;
+    GLint       u_transform, u_texel;
+    size_t      vbo_size;
+#endif
+} GLSFstate;
+#endif
+
+/**
+ * A string laid out by a batch in an earlier frame: what it was laid out
+ * with, where, and its instances in the batch's cached array. Its bytes
+ * are kept from offset in the batch's bytes array and compared when the
+ * hash matches, so colliding strings are never mixed up. Valid while the
+ * cache has the same number of glyphs.
+ */
+typedef struct {
+    const struct GLSFfont* font;
+    uint64_t hash;
+    size_t   length, offset, first, count;
+    float    x, y, width, fraction;
+    uint8_t  color[4];
+    uint32_t generation, used;
+} GLSFlayout;
+
+/**
+ * Strings laid out for one font, waiting to be drawn. Batches are
+ * independent so several threads or contexts can each build their own.
+ * Layout counters are added to the font's stats when drawn. Instances
+ * are allocated through allocator, malloc unless set after glsfInitBatch.
+ * Glyphs outside clip are left out when clipping, see glsfBatchClip.
+ * Layouts are kept for keep draws when caching, see glsfBatchCache.
+ */
 typedef struct {
-    stbtt_fontinfo info;
-    uint8_t*       data;
-    int32_t        ascent, descent, linegap;
-    float          size;
-    GLSFglyph*     glyphs;
-    size_t         num_glyphs;
-    GLSFvertex*    vertices;
-    size_t         num_vertices, max_vertices;
+    struct GLSFfont* font;
+    GLSFinstance*    instances;
+    size_t           num_instances, max_instances;
+    GLSFstats        stats;
+    GLSFallocator    allocator;
+    float            clip[4];
+    int32_t          clipping;
+    GLSFlayout*      layouts;
+    size_t           num_layouts, max_layouts;
+    GLSFinstance*    cached;
+    size_t           num_cached, max_cached;
+    char*            bytes;
+    size_t           num_bytes, max_bytes;
+    uint32_t         frame, keep;
+} GLSFbatch;
+
+/**
+ * A font as drawn in one context: its own texture holding the first
+ * num_synced glyphs of the shared cache's atlas, backend, batch and
+ * counters.
+ */
+typedef struct GLSFfont {
+    GLSFcache*     cache;
+    uint32_t       num_synced;
+    uint32_t       async;
+    uint32_t       phases;
+    GLSFbatch      batch;
     GLSFtexture    texture;
+    GLSFbackend    backend;
+    GLSFstats      stats;
+    GLSFtrace      trace;
+#ifndef GLSF_NO_GL
+    GLSFstate      default_state;
+#endif
 } GLSFfont;
 
-static GLSFfont* _glsf_font = NULL;
+/**
+ * A long text drawn a screen at a time. The byte each line starts at,
+ * breaks at width included, is indexed only as far as drawing has needed
+ * so a frame costs the lines in view, not the length of the text. Lines
+ * around the view stay laid out in batch and scrolling over them only
+ * moves them when drawn. Text is copied in with glsfAppendDocument and
+ * memory comes from allocator, malloc unless set after glsfInitDocument.
+ */
+typedef struct {
+    GLSFfont*     font;
+    char*         text;
+    size_t        length, max_length;
+    float         width;
+    size_t*       lines;
+    size_t        num_lines, max_lines, indexed;
+    GLSFbatch     batch;
+    size_t*       spans;
+    size_t        max_spans, first, last;
+    float         height, color[4];
+    uint32_t      synced;
+    GLSFallocator allocator;
+} GLSFdocument;
+
+/**
+ * A line of a console: its instances in the ring, the row it starts at
+ * counted from the first line ever appended, rows it wraps to and which
+ * pass over the instance ring it was written in.
+ */
+typedef struct {
+    size_t   first, count;
+    uint64_t row;
+    uint32_t rows, epoch;
+} GLSFconsoleline;
+
+/**
+ * The last lines appended to a log, drawn newest at the bottom. A line is
+ * laid out once when appended, into a ring of max_instances instances
+ * positioned relative to the row the ring was last started over at, so
+ * drawing is one draw call or two where the ring wraps. The oldest lines
+ * are dropped when either ring is full. Rows are as high as the face's
+ * lines with glyphs on its baseline, lines laid out before a taller glyph
+ * loaded stay in line with those after. Memory comes from allocator,
+ * malloc unless set after glsfInitConsole.
+ */
+typedef struct {
+    GLSFfont*        font;
+    float            width, height, baseline;
+    GLSFconsoleline* lines;
+    size_t           max_lines, first_line, num_lines;
+    GLSFinstance*    instances;
+    size_t           max_instances, write, wrapped;
+    uint64_t         rows, base[2];
+    uint32_t         epoch;
+    GLSFbatch        batch;
+    GLSFallocator    allocator;
+} GLSFconsole;
+
+/**
+ * A line of an editor: its bytes of text, the break included, and its
+ * number of instances.
+ */
+typedef struct {
+    size_t length, count;
+} GLSFeditline;
+
+/**
+ * Editable text keeping every line laid out. Instances are kept in line
+ * order with a gap at the last edit, lines below it are moved down by
+ * shift pixels when drawn. An edit lays out again from the edited line
+ * until breaks line up with the old ones and writes those lines into the
+ * gap, so it costs the lines it changes and the distance from the last
+ * edit. Glyphs are laid out as they are when edited, those still loading
+ * in async modes stay left out. Memory comes from allocator, malloc
+ * unless set after glsfInitEditor.
+ */
+typedef struct {
+    GLSFfont*     font;
+    char*         text;
+    size_t        length, max_length;
+    float         width, height, shift, color[4];
+    GLSFeditline* lines;
+    size_t        num_lines, max_lines;
+    GLSFinstance* instances;
+    size_t        max_instances, gap, gap_end;
+    size_t        gap_line, gap_byte;
+    GLSFeditline* edits;
+    size_t        max_edits;
+    GLSFbatch     batch;
+    GLSFallocator allocator;
+} GLSFeditor;
+
+#ifndef GLSF_THREAD_LOCAL
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define GLSF_THREAD_LOCAL thread_local
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define GLSF_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define GLSF_THREAD_LOCAL __declspec(thread)
+#else
+#define GLSF_THREAD_LOCAL __thread
+#endif
+#endif
+
+static GLSF_THREAD_LOCAL GLSFbatch _glsf_batch;
 
 static GLSFfont*  glsfCreateFont( const char*, float, const char* );
+static GLSFfont*  glsfCreateFontEx( const char*, float, const char*, const GLSFallocator* );
+static GLSFfont*  glsfCreateFontShared( GLSFfont* );
+static GLSFface*  glsfLoadFace( const char*, const GLSFallocator* );
+static GLSFface*  glsfRetainFace( GLSFface* );
+static void       glsfReleaseFace( GLSFface* );
+static GLSFfont*  glsfCreateFontFace( GLSFface*, float, const char* );
 static void       glsfDestroyFont( GLSFfont* );
 static int32_t    glsfLoadGlyph( GLSFfont*, uint32_t, GLSFglyph* );
+static int32_t    glsfLoadVariant( GLSFfont*, uint32_t, int32_t, GLSFglyph* );
 static int32_t    glsfLoadBitmap( GLSFfont*, GLSFglyph*, GLSFbitmap* );
-static void       glsfFreeBitmap( GLSFbitmap* );
-static int32_t    glsfLoadTexture( GLSFfont*, GLSFglyph*, size_t, GLSFtexture* );
-static void       glsfFreeTexture( GLSFtexture* );
+static void       glsfFreeBitmap( GLSFfont*, GLSFbitmap* );
+static void       glsfFreeTexture( GLSFfont*, GLSFtexture* );
 static int32_t    glsfUpdateFont( GLSFfont*, GLSFglyph*, size_t );
-static GLSFglyph* glsfGetGlyph( GLSFfont*, uint32_t );
+static int32_t    glsfGrowArray( const GLSFallocator*, void**, size_t*, size_t, size_t );
+static GLSFglyphrecord* glsfFindGlyph( GLSFfont*, uint32_t );
+static GLSFglyphrecord* glsfGetGlyph( GLSFfont*, uint32_t );
+static GLSFglyphrecord* glsfGetVariant( GLSFfont*, uint32_t, int32_t );
+static GLSFglyphrecord* glsfRequestGlyph( GLSFfont*, uint32_t );
+static GLSFglyphrecord* glsfRequestVariant( GLSFfont*, uint32_t, int32_t );
+static int32_t    glsfSyncFont( GLSFfont* );
+static int32_t    glsfRestoreFont( GLSFfont* );
+static int32_t    glsfSetAsync( GLSFfont*, uint32_t );
+static void       glsfSetSubpixel( GLSFfont*, uint32_t );
+static void       glsfSetOversampling( GLSFfont*, uint32_t, uint32_t );
 static void       glsfDrawString( GLSFfont*, const float[4], const float[4], const char* );
+static void       glsfEnqueueStringN( GLSFfont*, const float[4], const float[4], const char*, size_t );
+static void       glsfSetClip( GLSFfont*, const float[4] );
+static void       glsfSetLayoutCache( GLSFfont*, uint32_t );
+static void       glsfSetBackend( GLSFfont*, const GLSFbackend* );
+static void       glsfGetStats( const GLSFfont*, GLSFstats* );
+static void       glsfResetStats( GLSFfont* );
+static void       glsfResetCacheStats( GLSFfont* );
+static void       glsfSetTrace( GLSFfont*, const GLSFtrace* );
+static void       glsfInitChromeTrace( GLSFchrometrace*, FILE* );
+static void       glsfFinishChromeTrace( GLSFchrometrace* );
+static GLSFtrace  glsfChromeTrace( GLSFchrometrace* );
+static void       glsfInitRecorder( GLSFrecorder*, uint32_t );
+static void       glsfClearRecorder( GLSFrecorder* );
+static void       glsfFreeRecorder( GLSFrecorder* );
+static GLSFbackend glsfRecorderBackend( GLSFrecorder* );
+static void       glsfEmitQuads( const GLSFdraw*, void (*)( void*, const GLSFquad* ), void* );
+static void       glsfExpandInstances( const GLSFdraw*, GLSFvertex* );
+#ifndef GLSF_NO_GL
+static void       glsfInitState( GLSFstate*, uint32_t );
+static void       glsfFreeState( GLSFstate* );
+static void       glsfResetState( GLSFstate* );
+static void       glsfLoseState( GLSFstate* );
+static void       glsfSetViewport( GLSFstate*, int32_t, int32_t, int32_t, int32_t );
+static void       glsfSetState( GLSFfont*, GLSFstate* );
+static GLSFbackend glsfGLBackend( GLSFstate* );
+#endif
+static void       glsfInitBatch( GLSFbatch* );
+static void       glsfFreeBatch( GLSFbatch* );
+static void       glsfBatchClip( GLSFbatch*, const float[4] );
+static void       glsfBatchCache( GLSFbatch*, uint32_t );
+static void       glsfBatchBegin( GLSFbatch*, GLSFfont* );
+static void       glsfBatchString( GLSFbatch*, const float[4], const float[4], const char* );
+static void       glsfBatchStringN( GLSFbatch*, const float[4], const float[4], const char*, size_t );
+static void       glsfBatchEnd( GLSFbatch* );
+static GLSFbatch* glsfGetBatch();
 static void       glsfBegin( GLSFfont* );
 static void       glsfEnd();
 static void       glsfString( const float[4], const float[4], const char* );
+static void       glsfStringN( const float[4], const float[4], const char*, size_t );
+static void       glsfInitDocument( GLSFdocument*, GLSFfont*, float );
+static void       glsfFreeDocument( GLSFdocument* );
+static int32_t    glsfAppendDocument( GLSFdocument*, const char*, size_t );
+static void       glsfResizeDocument( GLSFdocument*, float );
+static int32_t    glsfIndexDocument( GLSFdocument*, size_t );
+static void       glsfDrawDocument( GLSFdocument*, const float[4], const float[4], float );
+static void       glsfInitConsole( GLSFconsole*, GLSFfont*, float, size_t, size_t );
+static void       glsfFreeConsole( GLSFconsole* );
+static void       glsfClearConsole( GLSFconsole* );
+static int32_t    glsfAppendConsole( GLSFconsole*, const float[4], const char* );
+static void       glsfDrawConsole( GLSFconsole*, const float[4] );
+static void       glsfInitEditor( GLSFeditor*, GLSFfont*, float, const float[4] );
+static void       glsfFreeEditor( GLSFeditor* );
+static int32_t    glsfEditText( GLSFeditor*, size_t, size_t, const char*, size_t );
+static void       glsfDrawEditor( GLSFeditor*, float, float );
+
+/**
+ * @fn glsfTime
+ * @brief Monotonic time in seconds where available.
+ */
+static double glsfTime()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+/**
+ * @fn glsfGetStats
+ * @brief Copies the font's counters, all zero with GLSF_NO_STATS.
+ */
+static void glsfGetStats( const GLSFfont* font, GLSFstats* stats )
+{
+    *stats = font->stats;
+    
+    glsfLockMutex(&font->cache->mutex);
+    stats->glyphs_rasterized = font->cache->stats.glyphs_rasterized;
+    stats->raster_time = font->cache->stats.raster_time;
+    glsfUnlockMutex(&font->cache->mutex);
+}
+
+/**
+ * @fn glsfResetStats
+ * @brief Zeroes the font's counters, typically once per frame. Those of
+ *        its cache are left to glsfResetCacheStats.
+ */
+static void glsfResetStats( GLSFfont* font )
+{
+    memset(&font->stats, 0, sizeof(GLSFstats));
+}
+
+/**
+ * @fn glsfResetCacheStats
+ * @brief Zeroes the counters of the font's cache, glyphs rasterized and
+ *        raster time, for every font sharing it.
+ */
+static void glsfResetCacheStats( GLSFfont* font )
+{
+    glsfLockMutex(&font->cache->mutex);
+    memset(&font->cache->stats, 0, sizeof(GLSFstats));
+    glsfUnlockMutex(&font->cache->mutex);
+}
+
+/**
+ * @fn glsfSetTrace
+ * @brief Install trace callbacks for a font, NULL removes them.
+ */
+static void glsfSetTrace( GLSFfont* font, const GLSFtrace* trace )
+{
+    if(trace)
+        font->trace = *trace;
+    else
+        memset(&font->trace, 0, sizeof(GLSFtrace));
+}
+
+/**
+ * @fn glsfTraceRaster
+ * @brief Reports rasterizing a glyph from span[0] to span[1], once the
+ *        cache's lock it was done under is released. Nothing when span[1]
+ *        is zero, it was not rasterized.
+ */
+static void glsfTraceRaster( GLSFfont* font, uint32_t codepoint, 
+                             const double span[2] )
+{
+#ifndef GLSF_NO_TRACE
+    GLSFtraceevent event = { "glsfRasterGlyph", codepoint, 1, 0, 0.0 };
+    if(span[1] == 0.0)
+        return;
+    if(font->trace.begin) {
+        event.time = span[0];
+        font->trace.begin(font->trace.user, &event);
+    }
+    if(font->trace.end) {
+        event.time = span[1];
+        font->trace.end(font->trace.user, &event);
+    }
+#else
+    (void)font; (void)codepoint; (void)span;
+#endif
+}
+
+/**
+ * @fn glsfWriteChromeEvent
+ */
+static void glsfWriteChromeEvent( GLSFchrometrace* writer, 
+                                  const GLSFtraceevent* event, char phase )
+{
+    // Fonts used on several threads may write at once, each fprintf is
+    // written whole.
+    fprintf(writer->file, "%s{\"name\":\"%s\",\"cat\":\"glsf\",\"ph\":\"%c\","
+            "\"ts\":%.3f,\"pid\":%u,\"tid\":%u,\"args\":{\"codepoint\":%u,"
+            "\"glyphs\":%u,\"bytes\":%llu}}",
+            glsfAddCount(&writer->num_events, 1) > 1 ? ",\n" : "", event->name, 
+            phase, event->time * 1e6, writer->pid, glsfThreadId(), 
+            event->codepoint, event->num_glyphs, (unsigned long long)event->bytes);
+}
+
+static void glsfChromeBegin( void* user, const GLSFtraceevent* event )
+{
+    glsfWriteChromeEvent((GLSFchrometrace*)user, event, 'B');
+}
+
+static void glsfChromeEnd( void* user, const GLSFtraceevent* event )
+{
+    glsfWriteChromeEvent((GLSFchrometrace*)user, event, 'E');
+}
+
+/**
+ * @fn glsfInitChromeTrace
+ * @brief Starts a trace in an opened file. The file stays owned by the
+ *        caller, which may also write its own events in between.
+ */
+static void glsfInitChromeTrace( GLSFchrometrace* writer, FILE* file )
+{
+    writer->file = file;
+    writer->pid = 1;
+    writer->num_events = 0;
+    fprintf(file, "[\n");
+}
+
+/**
+ * @fn glsfFinishChromeTrace
+ */
+static void glsfFinishChromeTrace( GLSFchrometrace* writer )
+{
+    fprintf(writer->file, "\n]\n");
+    fflush(writer->file);
+}
+
+/**
+ * @fn glsfChromeTrace
+ * @brief Trace callbacks writing to a Chrome trace, for glsfSetTrace.
+ */
+static GLSFtrace glsfChromeTrace( GLSFchrometrace* writer )
+{
+    GLSFtrace trace;
+    trace.user = writer;
+    trace.begin = glsfChromeBegin;
+    trace.end = glsfChromeEnd;
+    return trace;
+}
+
+/**
+ * @fn glsfLoadGlyph
+ */
+static int32_t glsfLoadGlyph( GLSFfont* font, uint32_t codepoint, 
+                              GLSFglyph* glyph )
+{
+    GLSFcache* cache = font->cache;
+    GLSFtraceevent event = { "glsfLoadGlyph", codepoint, 1, 0, 0.0 };
+    GLSF_TRACE(font, begin, &event);
+    
+    memset(glyph, 0, sizeof(GLSFglyph));
+    glyph->codepoint = codepoint;
+    glyph->index = stbtt_FindGlyphIndex(&cache->face->info, codepoint);
+    if(glyph->index != 0) {
+        glyph->scale = stbtt_ScaleForPixelHeight(&cache->face->info, cache->size);
+        
+        int32_t lsb;
+        stbtt_GetGlyphHMetrics(&cache->face->info, glyph->index, 
+                               &glyph->advance, &lsb);
+        stbtt_GetGlyphBitmapBox(&cache->face->info, glyph->index, glyph->scale,
+                                glyph->scale, &glyph->x0, &glyph->y0,
+                                &glyph->x1, &glyph->y1);
+    }
+    
+    GLSF_TRACE(font, end, &event);
+    return glyph->index != 0 ? GL_TRUE : GL_FALSE;
+}
+
+/**
+ * @fn glsfLoadVariant
+ * @brief Like glsfLoadGlyph, for the glyph rasterized phase 64ths of a
+ *        pixel to the right.
+ */
+static int32_t glsfLoadVariant( GLSFfont* font, uint32_t codepoint, 
+                                int32_t phase, GLSFglyph* glyph )
+{
+    if(glsfLoadGlyph(font, codepoint, glyph) == GL_FALSE)
+        return GL_FALSE;
+    
+    // The shift may push the box a pixel right.
+    glyph->phase = phase;
+    stbtt_GetGlyphBitmapBoxSubpixel(&font->cache->face->info, glyph->index, 
+                                    glyph->scale, glyph->scale, 
+                                    phase / 64.0f, 0.0f, &glyph->x0, 
+                                    &glyph->y0, &glyph->x1, &glyph->y1);
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfDownsample
+ * @brief Box filters an image oversampled by ox and oy, not both one,
+ *        down to width by height pixels. sums holds a row of the
+ *        source's column sums.
+ */
+static void glsfDownsample( const uint8_t* src, int32_t src_stride, 
+                            int32_t ox, int32_t oy, uint16_t* sums, 
+                            uint8_t* dest, int32_t width, int32_t height,
+                            int32_t stride )
+{
+    // Divide by multiplying with a rounded up 16-bit reciprocal, exact
+    // for every sum a box of at most 4 by 4 can have.
+    int32_t n = ox * oy;
+    uint32_t scale = (65536 + n - 1) / n;
+    int32_t src_width = width * ox;
+    int32_t x, y, i;
+#ifdef GLSF_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i half = _mm_set1_epi16((int16_t)(n / 2));
+    const __m128i reciprocal = _mm_set1_epi16((int16_t)scale);
+#endif
+    
+    for(y = 0; y < height; ++y) {
+        const uint8_t* row = src + (size_t)y * oy * src_stride;
+        
+        // Sum oy rows.
+        x = 0;
+#ifdef GLSF_SSE2
+        for(; x + 16 <= src_width; x += 16) {
+            __m128i lo = zero, hi = zero;
+            for(i = 0; i < oy; ++i) {
+                __m128i v = _mm_loadu_si128((const __m128i*)(row + (size_t)i * src_stride + x));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            }
+            _mm_storeu_si128((__m128i*)(sums + x), lo);
+            _mm_storeu_si128((__m128i*)(sums + x + 8), hi);
+        }
+        for(; x + 8 <= src_width; x += 8) {
+            __m128i lo = zero;
+            for(i = 0; i < oy; ++i) {
+                __m128i v = _mm_loadl_epi64((const __m128i*)(row + (size_t)i * src_stride + x));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+            }
+            _mm_storeu_si128((__m128i*)(sums + x), lo);
+        }
+#endif
+        for(; x < src_width; ++x) {
+            uint32_t sum = 0;
+            for(i = 0; i < oy; ++i)
+                sum += row[(size_t)i * src_stride + x];
+            sums[x] = (uint16_t)sum;
+        }
+        
+        // Sum ox columns and divide.
+        uint8_t* out = dest + (size_t)y * stride;
+        x = 0;
+#ifdef GLSF_SSE2
+        if(ox == 1 || ox == 2) {
+            for(; x + 8 <= width; x += 8) {
+                __m128i sum;
+                if(ox == 2) {
+                    __m128i a = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + x * 2)), ones);
+                    __m128i b = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(sums + x * 2 + 8)), ones);
+                    sum = _mm_packs_epi32(a, b);
+                } else {
+                    sum = _mm_loadu_si128((const __m128i*)(sums + x));
+                }
+                sum = _mm_mulhi_epu16(_mm_add_epi16(sum, half), reciprocal);
+                _mm_storel_epi64((__m128i*)(out + x), _mm_packus_epi16(sum, zero));
+            }
+        }
+#endif
+        for(; x < width; ++x) {
+            uint32_t sum = n / 2;
+            for(i = 0; i < ox; ++i)
+                sum += sums[x * ox + i];
+            out[x] = (uint8_t)((sum * scale) >> 16);
+        }
+    }
+}
+
+/**
+ * @fn glsfLoadOutline
+ * @brief The outline of a glyph, decoded from the font the first time it
+ *        is asked for. Outlines never change or move once loaded, they
+ *        may be used unlocked. The cache's mutex must be held.
+ */
+static const GLSFoutline* glsfLoadOutline( GLSFcache* cache, int32_t index )
+{
+    if(index <= 0 || index >= 65536)
+        return NULL;
+    
+    GLSFoutline*** chunk = &cache->outlines[index / GLSF_OUTLINE_CHUNK];
+    if(!*chunk) {
+        *chunk = (GLSFoutline**)glsfAlloc(&cache->allocator, 
+                                          sizeof(GLSFoutline*) * GLSF_OUTLINE_CHUNK);
+        if(!*chunk)
+            return NULL;
+        memset(*chunk, 0, sizeof(GLSFoutline*) * GLSF_OUTLINE_CHUNK);
+    }
+    GLSFoutline** outline = &(*chunk)[index % GLSF_OUTLINE_CHUNK];
+    if(*outline)
+        return *outline;
+    
+    // Decoded into the arena, kept in one block with its header.
+    stbtt_fontinfo info = cache->face->info;
+    info.userdata = &cache->arena;
+    stbtt_vertex* vertices = NULL;
+    int32_t num_vertices = stbtt_GetGlyphShape(&info, index, &vertices);
+    *outline = (GLSFoutline*)glsfAlloc(&cache->allocator, sizeof(GLSFoutline) + 
+                                       sizeof(stbtt_vertex) * num_vertices);
+    if(*outline) {
+        (*outline)->num_vertices = num_vertices;
+        (*outline)->vertices = (stbtt_vertex*)(*outline + 1);
+        if(num_vertices > 0)
+            memcpy((*outline)->vertices, vertices, sizeof(stbtt_vertex) * num_vertices);
+    }
+    stbtt_FreeShape(&info, vertices);
+    glsfResetArena(&cache->arena);
+    return *outline;
+}
+
+/**
+ * @fn glsfRasterGlyph
+ * @brief Renders a glyph's outline into pixels with the given row
+ *        stride. The rasterizer's buffers come from arena, reset it
+ *        afterwards. Callers trace it, often after unlocking the cache.
+ */
+static void glsfRasterGlyph( GLSFfont* font, GLSFarena* arena, 
+                             const GLSFglyph* glyph, 
+                             const GLSFoutline* outline, uint8_t* pixels, 
+                             int32_t stride )
+{
+    int32_t width = glyph->x1 - glyph->x0;
+    int32_t height = glyph->y1 - glyph->y0;
+    if(!outline || width <= 0 || height <= 0)
+        return;
+    
+    GLSFcache* cache = font->cache;
+    float shift = glyph->phase / 64.0f;
+    int32_t ox = glsfLoadCount(&cache->oversample_x);
+    int32_t oy = glsfLoadCount(&cache->oversample_y);
+    if(ox <= 1 && oy <= 1) {
+        stbtt__bitmap bitmap = { width, height, stride, pixels };
+        stbtt_RasterizeSubpixel(&bitmap, 0.35f, outline->vertices, 
+                                outline->num_vertices, glyph->scale, 
+                                glyph->scale, shift, 0.0f, glyph->x0, 
+                                glyph->y0, 1, arena);
+        return;
+    }
+    
+    // The oversampled box lies within the glyph's box scaled up, but for
+    // rounding. A texel of margin keeps that from writing out of bounds.
+    int32_t big_width = width * ox + 2, big_height = height * oy + 2;
+    uint8_t* big = (uint8_t*)glsfArenaAlloc(arena, (size_t)big_width * big_height);
+    uint16_t* sums = (uint16_t*)glsfArenaAlloc(arena, sizeof(uint16_t) * width * ox);
+    if(big && sums) {
+        memset(big, 0, (size_t)big_width * big_height);
+        int32_t x0, y0, x1, y1;
+        stbtt_GetGlyphBitmapBoxSubpixel(&cache->face->info, glyph->index, glyph->scale * ox, 
+                                        glyph->scale * oy, shift * ox, 0.0f,
+                                        &x0, &y0, &x1, &y1);
+        int32_t left = x0 - glyph->x0 * ox + 1, top = y0 - glyph->y0 * oy + 1;
+        stbtt__bitmap bitmap = { x1 - x0, y1 - y0, big_width, 
+                                 big + (size_t)top * big_width + left };
+        if(left >= 0 && top >= 0 && bitmap.w + left <= big_width && 
+           bitmap.h + top <= big_height && bitmap.w > 0 && bitmap.h > 0)
+            stbtt_RasterizeSubpixel(&bitmap, 0.35f, outline->vertices, 
+                                    outline->num_vertices, glyph->scale * ox, 
+                                    glyph->scale * oy, shift * ox, 0.0f, 
+                                    x0, y0, 1, arena);
+        glsfDownsample(big + big_width + 1, big_width, ox, oy, sums, 
+                       pixels, width, height, stride);
+    }
+    glsfArenaFree(arena, sums);
+    glsfArenaFree(arena, big);
+}
+
+/**
+ * @fn glsfLoadBitmap
+ */
+static int32_t glsfLoadBitmap( GLSFfont* font, GLSFglyph* glyph, 
+                               GLSFbitmap* bitmap )
+{
+    bitmap->width = glyph->x1 - glyph->x0;
+    bitmap->height = glyph->y1 - glyph->y0;
+    bitmap->data = (uint8_t*)glsfAlloc(&font->cache->allocator, sizeof(uint8_t) * 
+                                       (bitmap->width * bitmap->height));
+    if(!bitmap->data) 
+        return GL_FALSE;
+    
+    // In the cache's arena, warmed up already, under its lock as in
+    // glsfInsertGlyph. Traced once unlocked.
+    double raster[2];
+    memset(bitmap->data, 0, bitmap->width * bitmap->height);
+    glsfLockMutex(&font->cache->mutex);
+    raster[0] = glsfTime();
+    const GLSFoutline* outline = glsfLoadOutline(font->cache, glyph->index);
+    glsfRasterGlyph(font, &font->cache->arena, glyph, outline, bitmap->data, bitmap->width);
+    glsfResetArena(&font->cache->arena);
+    raster[1] = glsfTime();
+    glsfUnlockMutex(&font->cache->mutex);
+    glsfTraceRaster(font, glyph->codepoint, raster);
+
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfFreeBitmap
+ */
+static void glsfFreeBitmap( GLSFfont* font, GLSFbitmap* bitmap )
+{
+    glsfFree(&font->cache->allocator, bitmap->data);
+    memset(bitmap, 0, sizeof(GLSFbitmap));
+}
+
+/**
+ * @fn glsfFreeTexture
+ */
+static void glsfFreeTexture( GLSFfont* font, GLSFtexture* texture )
+{
+    if(font->backend.free_texture)
+        font->backend.free_texture(font->backend.user, texture);
+    memset(texture, 0, sizeof(GLSFtexture));
+}
+
+/**
+ * @fn glsfHashGlyph
+ * @brief Spreads codepoints and their phases over a table, high bits
+ *        included. Codepoints fit in 21 bits, phases go above them.
+ */
+static uint32_t glsfHashGlyph( uint32_t codepoint, int32_t phase )
+{
+    uint32_t hash = (codepoint ^ ((uint32_t)phase << 24)) * 2654435761u;
+    return hash ^ (hash >> 16);
+}
+
+/**
+ * @fn glsfGlyphRecord
+ * @brief A cache's record by number. Published by the release store of
+ *        its slot, which the lookup reading it acquired.
+ */
+static GLSFglyphrecord* glsfGlyphRecord( GLSFcache* cache, uint32_t number )
+{
+    return &cache->chunks[number / GLSF_CHUNK_GLYPHS][number % GLSF_CHUNK_GLYPHS];
+}
+
+/**
+ * @fn glsfLookupGlyph
+ * @brief Lock-free lookup of a glyph record, including records of
+ *        codepoints the font lacks. Phase zero is the unshifted glyph.
+ */
+static GLSFglyphrecord* glsfLookupGlyph( GLSFcache* cache, uint32_t codepoint,
+                                         int32_t phase )
+{
+    GLSFglyphtable* table = (GLSFglyphtable*)glsfLoadPointer(&cache->table);
+    if(!table)
+        return NULL;
+    
+    uint32_t i = glsfHashGlyph(codepoint, phase);
+    for(;; ++i) {
+        uint32_t slot = glsfLoadCount(&table->slots[i & table->mask]);
+        if(slot == 0)
+            return NULL;
+        GLSFglyphrecord* glyph = glsfGlyphRecord(cache, slot - 1);
+        if(glyph->codepoint == codepoint && glyph->phase == phase)
+            return glyph;
+    }
+}
+
+/**
+ * @fn glsfPackGlyph
+ * @brief Finds room for a width by height glyph in the cache's atlas,
+ *        growing it up to GLSF_MAX_ATLAS_HEIGHT if needed. Glyphs are one
+ *        texel apart so they do not bleed into each other when filtered.
+ *        The mutex must be held.
+ */
+static int32_t glsfPackGlyph( GLSFcache* cache, int32_t width, int32_t height,
+                              int32_t* s, int32_t* t )
+{
+    // The lowest shelf it fits without wasting more than a quarter.
+    GLSFshelf* shelf = NULL;
+    size_t i;
+    for(i = 0; i < cache->num_shelves; ++i) {
+        GLSFshelf* candidate = &cache->shelves[i];
+        if(candidate->height < height || candidate->height > height + height / 4 + 1 ||
+           candidate->s + width > cache->atlas_width)
+            continue;
+        if(!shelf || candidate->height < shelf->height)
+            shelf = candidate;
+    }
+    
+    if(!shelf) {
+        if(width > cache->atlas_width)
+            return GL_FALSE;
+        
+        // Doubling the height keeps rows in place, glyphs never move.
+        int32_t needed = cache->atlas_used + height + 1;
+        if(needed > GLSF_MAX_ATLAS_HEIGHT) {
+            if(!cache->atlas_full)
+                fprintf(stderr, "Glyph atlas full at %ix%i.\n", cache->atlas_width, 
+                        cache->atlas_height);
+            cache->atlas_full = GL_TRUE;
+            return GL_FALSE;
+        }
+        if(glsfGrowArray(&cache->allocator, (void**)&cache->shelves, &cache->max_shelves,
+                         cache->num_shelves + 1, sizeof(GLSFshelf)) == GL_FALSE)
+            return GL_FALSE;
+        if(needed > cache->atlas_height) {
+            int32_t new_height = cache->atlas_height > 0 ? cache->atlas_height : 32;
+            while(new_height < needed)
+                new_height *= 2;
+            if(new_height > GLSF_MAX_ATLAS_HEIGHT)
+                new_height = GLSF_MAX_ATLAS_HEIGHT;
+            uint8_t* pixels = (uint8_t*)glsfRealloc(&cache->allocator, cache->pixels, 
+                                                    (size_t)cache->atlas_width * new_height);
+            if(!pixels)
+                return GL_FALSE;
+            memset(pixels + (size_t)cache->atlas_width * cache->atlas_height, 0,
+                   (size_t)cache->atlas_width * (new_height - cache->atlas_height));
+            cache->pixels = pixels;
+            cache->atlas_height = new_height;
+        }
+        
+        shelf = &cache->shelves[cache->num_shelves++];
+        shelf->t = cache->atlas_used;
+        shelf->height = height;
+        shelf->s = 0;
+        cache->atlas_used += height + 1;
+    }
+    
+    *s = shelf->s;
+    *t = shelf->t;
+    shelf->s += width + 1;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfInsertGlyph
+ * @brief Rasterizes a glyph into the atlas and publishes a record for
+ *        it, in place of a pending record for the same codepoint if any.
+ *        Given pixels are copied instead, a pending glyph gets no room.
+ *        The cache's mutex must be held. When rasterized, raster is set
+ *        to when it began and ended for glsfTraceRaster, else left as is.
+ */
+static GLSFglyphrecord* glsfInsertGlyph( GLSFfont* font, const GLSFglyph* glyph,
+                                         const uint8_t* pixels, double raster[2] )
+{
+    GLSFcache* cache = font->cache;
+    uint32_t count = cache->num_glyphs;
+    uint32_t chunk = count / GLSF_CHUNK_GLYPHS;
+    if(chunk >= GLSF_MAX_CHUNKS)
+        return NULL;
+    
+    // Keep the table at most half full. The new one is filled before it
+    // is published, readers still in the old one find what it had.
+    GLSFglyphtable* table = cache->table;
+    if(!table || (count + 1) * 2 > table->mask + 1) {
+        uint32_t size = table ? (table->mask + 1) * 2 : 64;
+        GLSFglyphtable* new_table = (GLSFglyphtable*)glsfAlloc(&cache->allocator, 
+                                                               sizeof(GLSFglyphtable));
+        if(!new_table)
+            return NULL;
+        new_table->slots = (uint32_t*)glsfAlloc(&cache->allocator, 
+                                                size * sizeof(uint32_t));
+        if(!new_table->slots) {
+            glsfFree(&cache->allocator, new_table);
+            return NULL;
+        }
+        memset(new_table->slots, 0, size * sizeof(uint32_t));
+        new_table->mask = size - 1;
+        new_table->next = table;
+        
+        // Taken from the old table's slots, replaced records are not in it.
+        uint32_t i, j;
+        for(i = 0; table && i <= table->mask; ++i) {
+            if(!table->slots[i])
+                continue;
+            GLSFglyphrecord* old = glsfGlyphRecord(cache, table->slots[i] - 1);
+            for(j = glsfHashGlyph(old->codepoint, old->phase); 
+                new_table->slots[j & new_table->mask]; ++j);
+            new_table->slots[j & new_table->mask] = table->slots[i];
+        }
+        glsfStorePointer(&cache->table, new_table);
+        table = new_table;
+    }
+    
+    if(!cache->chunks[chunk]) {
+        cache->chunks[chunk] = (GLSFglyphrecord*)glsfAlloc(&cache->allocator, 
+                                                           sizeof(GLSFglyphrecord) * GLSF_CHUNK_GLYPHS);
+        if(!cache->chunks[chunk])
+            return NULL;
+    }
+    
+    // Layout reads only the record, advance in pixels and the box as
+    // offset and size.
+    GLSFglyphrecord* record = &cache->chunks[chunk][count % GLSF_CHUNK_GLYPHS];
+    int32_t width = glyph->x1 - glyph->x0;
+    int32_t height = glyph->y1 - glyph->y0;
+    memset(record, 0, sizeof(GLSFglyphrecord));
+    record->codepoint = glyph->codepoint;
+    record->advance = (float)glyph->advance * glyph->scale;
+    record->x0 = (int16_t)glyph->x0;
+    record->y0 = (int16_t)glyph->y0;
+    record->w = (uint16_t)(width > 0 ? width : 0);
+    record->h = (uint16_t)(height > 0 ? height : 0);
+    record->phase = (uint8_t)glyph->phase;
+    record->pending = glyph->pending ? 1 : 0;
+    record->missing = glyph->index == 0 ? 1 : 0;
+    
+    // Rasterize once, textures copy from the atlas. A glyph with no room
+    // left keeps its advance and draws nothing, so it is not tried again.
+    int32_t s = 0, t = 0;
+    int32_t packed = glyph->index != 0 && width > 0 && height > 0 && !glyph->pending;
+    if(packed && glsfPackGlyph(cache, width, height, &s, &t) == GL_FALSE) {
+        if(!cache->atlas_full)
+            return NULL;
+        record->w = record->h = 0;
+        packed = GL_FALSE;
+    }
+    if(packed) {
+        record->s = (uint16_t)s;
+        record->t = (uint16_t)t;
+        
+        int32_t stride = cache->atlas_width;
+        uint8_t* dest = cache->pixels + (size_t)t * stride + s;
+        if(pixels) {
+            int32_t row;
+            for(row = 0; row < height; ++row)
+                memcpy(dest + (size_t)row * stride, pixels + (size_t)row * width, width);
+        } else {
+            double start = glsfTime();
+            const GLSFoutline* outline = glsfLoadOutline(cache, glyph->index);
+            glsfRasterGlyph(font, &cache->arena, glyph, outline, dest, stride);
+            glsfResetArena(&cache->arena);
+            double end = glsfTime();
+            GLSF_STAT_ADD(cache, raster_time, end - start);
+            GLSF_STAT_ADD(cache, glyphs_rasterized, 1);
+            if(raster) {
+                raster[0] = start;
+                raster[1] = end;
+            }
+        }
+        if((uint32_t)height > cache->height)
+            glsfStoreCount(&cache->height, (uint32_t)height);
+    }
+    
+    // Publish.
+    uint32_t i;
+    for(i = glsfHashGlyph(record->codepoint, record->phase); table->slots[i & table->mask]; ++i) {
+        GLSFglyphrecord* other = glsfGlyphRecord(cache, table->slots[i & table->mask] - 1);
+        if(other->codepoint == record->codepoint && other->phase == record->phase)
+            break;
+    }
+    glsfStoreCount(&table->slots[i & table->mask], count + 1);
+    glsfStoreCount(&cache->num_glyphs, count + 1);
+    return record;
+}
+
+/**
+ * @fn glsfUpdateFont
+ * @brief Adds glyphs to the font's cache, skipping those already in it.
+ *        Textures catch up when next drawn.
+ */
+static int32_t glsfUpdateFont( GLSFfont* font, GLSFglyph* glyphs, 
+                               size_t num_glyphs )
+{
+    if(num_glyphs == 0)
+        return GL_FALSE;
+    
+    GLSFtraceevent event = { "glsfUpdateFont", 0, (uint32_t)num_glyphs, 0, 0.0 };
+    GLSF_TRACE(font, begin, &event);
+    
+    // Locked a glyph at a time, each traced once unlocked.
+    int32_t result = GL_TRUE;
+    size_t i;
+    for(i = 0; i < num_glyphs && result == GL_TRUE; ++i) {
+        double raster[2] = { 0.0, 0.0 };
+        glsfLockMutex(&font->cache->mutex);
+        GLSFglyphrecord* existing = glsfLookupGlyph(font->cache, glyphs[i].codepoint, 
+                                                    glyphs[i].phase);
+        if(!existing || existing->pending) {
+            GLSFglyph glyph = glyphs[i];
+            glyph.pending = 0;
+            if(!glsfInsertGlyph(font, &glyph, NULL, raster))
+                result = GL_FALSE;
+        }
+        glsfUnlockMutex(&font->cache->mutex);
+        glsfTraceRaster(font, glyphs[i].codepoint, raster);
+    }
+    
+    GLSF_TRACE(font, end, &event);
+    return result;
+}
+
+/**
+ * @fn glsfUploadAtlas
+ * @brief Copies a rectangle of pixels to the font's texture.
+ */
+static void glsfUploadAtlas( GLSFfont* font, const int32_t rect[4], 
+                             const uint8_t* pixels, GLSFtraceevent* event )
+{
+    int32_t width = rect[2] - rect[0], height = rect[3] - rect[1];
+    if(width <= 0 || height <= 0)
+        return;
+    if(font->backend.update_texture)
+        font->backend.update_texture(font->backend.user, &font->texture, rect[0], rect[1], 
+                                     width, height, width, pixels);
+    GLSF_STAT_ADD(font, bytes_uploaded, width * height);
+    event->bytes += width * height;
+}
+
+/**
+ * @fn glsfSyncFont
+ * @brief Uploads glyphs added to the font's cache since the last sync,
+ *        by this font or any other sharing the cache. New glyphs are
+ *        uploaded as one rectangle per atlas shelf they are on. Done when
+ *        drawing, must be called in the context owning the font's texture.
+ */
+static int32_t glsfSyncFont( GLSFfont* font )
+{
+    GLSFcache* cache = font->cache;
+    if(glsfLoadCount(&cache->num_glyphs) == font->num_synced)
+        return GL_TRUE;
+    
+    // The atlas may be reallocated by an insert. What changed is copied
+    // out while holding the lock, the backend is called without it.
+    glsfLockMutex(&cache->mutex);
+    uint32_t count = cache->num_glyphs;
+    int32_t width = cache->atlas_width, height = cache->atlas_height;
+    int32_t rects[GLSF_MAX_DIRTY][4];
+    size_t num_rects = 0, j;
+    
+    int32_t recreate = height > 0 && (width > font->texture.width || 
+                                      height > font->texture.height);
+    if(recreate) {
+        // Recreated at the atlas' size, everything in one upload.
+        int32_t used = 0;
+        for(j = 0; j < cache->num_shelves; ++j)
+            if(cache->shelves[j].s > used)
+                used = cache->shelves[j].s;
+        rects[0][0] = rects[0][1] = 0;
+        rects[0][2] = used < width ? used : width;
+        rects[0][3] = cache->atlas_used;
+        num_rects = 1;
+    } else {
+        // Glyphs on one shelf become one rectangle. Past a few shelves
+        // the last rectangle takes in the rest.
+        uint32_t i;
+        for(i = font->num_synced; i < count; ++i) {
+            GLSFglyphrecord* glyph = glsfGlyphRecord(cache, i);
+            if(glyph->missing || glyph->pending || glyph->w == 0 || glyph->h == 0)
+                continue;
+            
+            int32_t rect[4] = { glyph->s, glyph->t, glyph->s + glyph->w, 
+                                glyph->t + glyph->h };
+            for(j = 0; j < num_rects && rects[j][1] != rect[1]; ++j);
+            if(j == num_rects && num_rects < GLSF_MAX_DIRTY) {
+                memcpy(rects[num_rects++], rect, sizeof(rect));
+                continue;
+            }
+            if(j == num_rects)
+                j = num_rects - 1;
+            if(rect[0] < rects[j][0]) rects[j][0] = rect[0];
+            if(rect[1] < rects[j][1]) rects[j][1] = rect[1];
+            if(rect[2] > rects[j][2]) rects[j][2] = rect[2];
+            if(rect[3] > rects[j][3]) rects[j][3] = rect[3];
+        }
+    }
+    
+    // Rectangles are packed one after another, rows tight.
+    size_t size = 0;
+    for(j = 0; j < num_rects; ++j)
+        size += (size_t)(rects[j][2] - rects[j][0]) * (rects[j][3] - rects[j][1]);
+    uint8_t* pixels = size ? (uint8_t*)glsfAlloc(&cache->allocator, size) : NULL;
+    if(size && !pixels) {
+        glsfUnlockMutex(&cache->mutex);
+        return GL_FALSE;
+    }
+    uint8_t* dest = pixels;
+    for(j = 0; j < num_rects; ++j) {
+        int32_t rect_width = rects[j][2] - rects[j][0], row;
+        for(row = rects[j][1]; row < rects[j][3]; ++row, dest += rect_width)
+            memcpy(dest, cache->pixels + (size_t)row * width + rects[j][0], rect_width);
+    }
+    glsfUnlockMutex(&cache->mutex);
+    
+    GLSFtraceevent event = { "glsfSyncFont", 0, count - font->num_synced, 0, 0.0 };
+    GLSF_TRACE(font, begin, &event);
+    int32_t result = GL_TRUE;
+    
+    if(recreate) {
+        GLSFtexture texture;
+        texture.name = 0;
+        texture.width = width;
+        texture.height = height;
+        
+        if(font->backend.create_texture &&
+           font->backend.create_texture(font->backend.user, &texture) == GL_FALSE) {
+            fprintf(stderr, "Failed creating texture.\n");
+            result = GL_FALSE;
+        } else {
+            GLSF_STAT_ADD(font, texture_reallocs, 1);
+            glsfFreeTexture(font, &font->texture);
+            font->texture = texture;
+        }
+    }
+    if(result == GL_TRUE) {
+        const uint8_t* src = pixels;
+        for(j = 0; j < num_rects; ++j) {
+            glsfUploadAtlas(font, rects[j], src, &event);
+            src += (size_t)(rects[j][2] - rects[j][0]) * (rects[j][3] - rects[j][1]);
+        }
+        font->num_synced = count;
+    }
+    glsfFree(&cache->allocator, pixels);
+    
+    GLSF_TRACE(font, end, &event);
+    return result;
+}
+
+/**
+ * @fn glsfRestoreFont
+ * @brief Rebuilds a font's texture after its context was lost, in the
+ *        new current one. The dead texture is forgotten, not freed, and
+ *        everything is uploaded from the cache's atlas at once without
+ *        rasterizing. States shared with glsfSetState need glsfLoseState.
+ */
+static int32_t glsfRestoreFont( GLSFfont* font )
+{
+#ifndef GLSF_NO_GL
+    glsfLoseState(&font->default_state);
+#endif
+    memset(&font->texture, 0, sizeof(GLSFtexture));
+    font->num_synced = 0;
+    return glsfSyncFont(font);
+}
+
+/**
+ * @fn glsfFindGlyph
+ * @brief Fetch a glyph by codepoint from font if already loaded. Safe
+ *        while other threads add glyphs.
+ */
+static GLSFglyphrecord* glsfFindGlyph( GLSFfont* font, uint32_t codepoint )
+{
+    GLSFglyphrecord* glyph = glsfLookupGlyph(font->cache, codepoint, 0);
+    return glyph && !glyph->missing && !glyph->pending ? glyph : NULL;
+}
+
+/**
+ * @fn glsfGetGlyph
+ * @brief Fetch a glyph by codepoint from font. Tries loading the glyph
+ *        and adding it if not found. Safe to call from several threads,
+ *        only a miss takes the cache's lock.
+ */
+static GLSFglyphrecord* glsfGetGlyph( GLSFfont* font, uint32_t codepoint )
+{
+    return glsfGetVariant(font, codepoint, 0);
+}
+
+/**
+ * @fn glsfGetVariant
+ * @brief glsfGetGlyph for the glyph shifted by phase, see
+ *        glsfLoadVariant.
+ */
+static GLSFglyphrecord* glsfGetVariant( GLSFfont* font, uint32_t codepoint, 
+                                        int32_t phase )
+{
+    // Fetch existing glyph in font.
+    GLSFglyphrecord* glyph = glsfLookupGlyph(font->cache, codepoint, phase);
+    if(glyph && !glyph->pending)
+        return !glyph->missing ? glyph : NULL;
+    
+    // Load the missing glyph, or remember that there is none. Measured
+    // before locking, traced callbacks may call back into glsf.
+    GLSFglyph new_glyph;
+    glsfLoadVariant(font, codepoint, phase, &new_glyph);
+    
+    // Another thread may have added it before we got the lock. One still
+    // queued for the rasterizer thread is loaded here without waiting.
+    double raster[2] = { 0.0, 0.0 };
+    glsfLockMutex(&font->cache->mutex);
+    glyph = glsfLookupGlyph(font->cache, codepoint, phase);
+    if(!glyph || glyph->pending)
+        glyph = glsfInsertGlyph(font, &new_glyph, NULL, raster);
+    glsfUnlockMutex(&font->cache->mutex);
+    glsfTraceRaster(font, codepoint, raster);
+    
+    return glyph && !glyph->missing ? glyph : NULL;
+}
+
+/**
+ * @fn glsfRequestGlyph
+ * @brief Like glsfGetGlyph but a glyph not loaded yet is queued for the
+ *        rasterizer thread started by glsfSetAsync. It is returned with
+ *        pending set: metrics are valid, there are no pixels to draw.
+ *        Without the thread glyphs are loaded right away.
+ */
+static GLSFglyphrecord* glsfRequestGlyph( GLSFfont* font, uint32_t codepoint )
+{
+    return glsfRequestVariant(font, codepoint, 0);
+}
+
+/**
+ * @fn glsfRequestVariant
+ * @brief glsfRequestGlyph for the glyph shifted by phase, see
+ *        glsfLoadVariant.
+ */
+static GLSFglyphrecord* glsfRequestVariant( GLSFfont* font, uint32_t codepoint,
+                                            int32_t phase )
+{
+    GLSFcache* cache = font->cache;
+    GLSFglyphrecord* glyph = glsfLookupGlyph(cache, codepoint, phase);
+    if(glyph)
+        return !glyph->missing ? glyph : NULL;
+    
+    // Measuring is cheap, only glyphs with pixels go to the thread. Done
+    // before locking like in glsfGetVariant.
+    GLSFglyph new_glyph;
+    glsfLoadVariant(font, codepoint, phase, &new_glyph);
+    
+    double raster[2] = { 0.0, 0.0 };
+    glsfLockMutex(&cache->mutex);
+    glyph = glsfLookupGlyph(cache, codepoint, phase);
+    if(!glyph) {
+        if(cache->running && new_glyph.index != 0 &&
+           new_glyph.x1 > new_glyph.x0 && new_glyph.y1 > new_glyph.y0 &&
+           glsfGrowArray(&cache->allocator, (void**)&cache->queue, &cache->max_queued,
+                         cache->num_queued + 1, sizeof(GLSFglyph)) == GL_TRUE)
+            new_glyph.pending = 1;
+        glyph = glsfInsertGlyph(font, &new_glyph, NULL, raster);
+#ifndef GLSF_NO_THREADS
+        if(glyph && glyph->pending) {
+            cache->queue[cache->num_queued++] = new_glyph;
+            glsfSignalCond(&cache->cond);
+        }
+#endif
+    }
+    glsfUnlockMutex(&cache->mutex);
+    glsfTraceRaster(font, codepoint, raster);
+    
+    return glyph && !glyph->missing ? glyph : NULL;
+}
+
+#ifndef GLSF_NO_THREADS
+/**
+ * @fn glsfRasterThread
+ * @brief Rasterizes queued glyphs outside the cache's lock until the
+ *        cache is freed.
+ */
+GLSF_THREAD_FN( glsfRasterThread, arg )
+{
+    GLSFcache* cache = (GLSFcache*)arg;
+    
+    // The thread has no font of its own, a blank one carries the cache.
+    GLSFfont font;
+    memset(&font, 0, sizeof(GLSFfont));
+    font.cache = cache;
+    
+    glsfLockMutex(&cache->mutex);
+    for(;;) {
+        while(cache->queue_head == cache->num_queued && !cache->quit)
+            glsfWaitCond(&cache->cond, &cache->mutex);
+        if(cache->quit)
+            break;
+        
+        GLSFglyph glyph = cache->queue[cache->queue_head++];
+        if(cache->queue_head == cache->num_queued)
+            cache->queue_head = cache->num_queued = 0;
+        if(!glsfLookupGlyph(cache, glyph.codepoint, glyph.phase)->pending)
+            continue;
+        const GLSFoutline* outline = glsfLoadOutline(cache, glyph.index);
+        glsfUnlockMutex(&cache->mutex);
+        
+        // The atlas may move meanwhile, rasterize to the thread's arena
+        // and copy it in once locked. The allocator may be called
+        // unlocked should the arena not be warmed up yet.
+        int32_t width = glyph.x1 - glyph.x0;
+        uint8_t* pixels = (uint8_t*)glsfArenaAlloc(&cache->thread_arena, 
+                                                   width * (glyph.y1 - glyph.y0));
+        double start = GLSF_STAT_TIME();
+        if(pixels)
+            glsfRasterGlyph(&font, &cache->thread_arena, &glyph, outline, pixels, width);
+        double raster_time = GLSF_STAT_TIME() - start;
+        
+        glsfLockMutex(&cache->mutex);
+        if(pixels) {
+            GLSF_STAT_ADD(cache, raster_time, raster_time);
+            GLSF_STAT_ADD(cache, glyphs_rasterized, 1);
+            
+            // Someone may have loaded it meanwhile with glsfGetGlyph.
+            glyph.pending = 0;
+            if(glsfLookupGlyph(cache, glyph.codepoint, glyph.phase)->pending)
+                glsfInsertGlyph(&font, &glyph, pixels, NULL);
+            glsfArenaFree(&cache->thread_arena, pixels);
+        }
+        glsfResetArena(&cache->thread_arena);
+    }
+    glsfUnlockMutex(&cache->mutex);
+    
+    return 0;
+}
+#endif
+
+/**
+ * @fn glsfInsertTofu
+ * @brief Adds the box drawn for pending glyphs. The cache's mutex must
+ *        be held.
+ */
+static GLSFglyphrecord* glsfInsertTofu( GLSFfont* font )
+{
+    GLSFcache* cache = font->cache;
+    float scale = stbtt_ScaleForPixelHeight(&cache->face->info, cache->size);
+    int32_t height = (int32_t)(cache->face->ascent * scale * 0.8f + 0.5f);
+    if(height < 3)
+        height = 3;
+    int32_t width = height * 3 / 5 > 3 ? height * 3 / 5 : 3;
+    
+    // No codepoint decodes to ~0, the record is only reached by pointer.
+    GLSFglyph glyph;
+    memset(&glyph, 0, sizeof(GLSFglyph));
+    glyph.codepoint = ~0u;
+    glyph.index = -1;
+    glyph.scale = 1.0f;
+    glyph.advance = width + 2;
+    glyph.x0 = 1;
+    glyph.x1 = 1 + width;
+    glyph.y0 = -height;
+    uint8_t* pixels = (uint8_t*)glsfArenaAlloc(&cache->arena, width * height);
+    if(!pixels)
+        return NULL;
+    
+    int32_t x, y;
+    for(y = 0; y < height; ++y)
+        for(x = 0; x < width; ++x)
+            pixels[y * width + x] = (x == 0 || y == 0 || x == width - 1 || 
+                                     y == height - 1) ? 255 : 0;
+    
+    GLSFglyphrecord* tofu = glsfInsertGlyph(font, &glyph, pixels, NULL);
+    glsfArenaFree(&cache->arena, pixels);
+    glsfResetArena(&cache->arena);
+    return tofu;
+}
+
+/**
+ * @fn glsfSetAsync
+ * @brief Choose what layout does with glyphs not loaded yet, one of the
+ *        GLSF_ASYNC_ modes. The first async mode set on any font of a
+ *        cache starts its rasterizer thread. Fails without threads.
+ */
+static int32_t glsfSetAsync( GLSFfont* font, uint32_t mode )
+{
+    if(mode == GLSF_ASYNC_BLOCK) {
+        font->async = mode;
+        return GL_TRUE;
+    }
+#ifdef GLSF_NO_THREADS
+    return GL_FALSE;
+#else
+    GLSFcache* cache = font->cache;
+    int32_t result = GL_TRUE;
+    
+    glsfLockMutex(&cache->mutex);
+    if(!cache->running) {
+        if(glsfStartThread(&cache->thread, glsfRasterThread, cache))
+            cache->running = 1;
+        else
+            result = GL_FALSE;
+    }
+    if(result == GL_TRUE && mode == GLSF_ASYNC_TOFU && !cache->tofu) {
+        GLSFglyphrecord* tofu = glsfInsertTofu(font);
+        if(tofu)
+            glsfStorePointer(&cache->tofu, tofu);
+        else
+            result = GL_FALSE;
+    }
+    glsfUnlockMutex(&cache->mutex);
+    
+    if(result == GL_TRUE)
+        font->async = mode;
+    return result;
+#endif
+}
+
+/**
+ * @fn glsfSetSubpixel
+ * @brief Position glyphs to a fraction of a pixel: each is rasterized in
+ *        up to phases horizontal shifts, as they are needed, and drawn
+ *        with the one closest to the pen. One, the default, draws every
+ *        glyph as rasterized at the pen. At most GLSF_MAX_PHASES.
+ */
+static void glsfSetSubpixel( GLSFfont* font, uint32_t phases )
+{
+    if(phases < 1)
+        phases = 1;
+    if(phases > GLSF_MAX_PHASES)
+        phases = GLSF_MAX_PHASES;
+    font->phases = phases;
+}
+
+/**
+ * @fn glsfSetOversampling
+ * @brief Rasterize glyphs at h times their width and v times their
+ *        height and box filter them down, smoothing small text. Glyphs
+ *        keep their size in the atlas and when drawn. Applies to every
+ *        font sharing the cache, for glyphs rasterized from then on, so
+ *        best set before any are loaded. At most GLSF_MAX_OVERSAMPLE.
+ */
+static void glsfSetOversampling( GLSFfont* font, uint32_t h, uint32_t v )
+{
+    h = h < 1 ? 1 : (h > GLSF_MAX_OVERSAMPLE ? GLSF_MAX_OVERSAMPLE : h);
+    v = v < 1 ? 1 : (v > GLSF_MAX_OVERSAMPLE ? GLSF_MAX_OVERSAMPLE : v);
+    glsfStoreCount(&font->cache->oversample_x, (int32_t)h);
+    glsfStoreCount(&font->cache->oversample_y, (int32_t)v);
+}
+
+/**
+ * @fn glsfNewFont
+ * @brief A font drawing the glyphs of cache, taking a reference to it.
+ */
+static GLSFfont* glsfNewFont( GLSFcache* cache )
+{
+    GLSFfont* new_font = (GLSFfont*)glsfAlloc(&cache->allocator, sizeof(GLSFfont));
+    if(!new_font)
+        return NULL;
+    memset(new_font, 0, sizeof(GLSFfont));
+    
+    new_font->cache = cache;
+    glsfAddCount(&cache->refs, 1);
+#ifndef GLSF_NO_GL
+    glsfInitState(&new_font->default_state, 0);
+    new_font->default_state.allocator = cache->allocator;
+    new_font->backend = glsfGLBackend(&new_font->default_state);
+#endif
+    
+    // Initialize instance array with some kind of size.
+    new_font->batch.font = new_font;
+    new_font->batch.allocator = cache->allocator;
+    glsfGrowArray(&cache->allocator, (void**)&new_font->batch.instances, 
+                  &new_font->batch.max_instances, 128, sizeof(GLSFinstance));
+    
+    return new_font;
+}
+
+/**
+ * @fn glsfFreeCache
+ */
+static void glsfFreeCache( GLSFcache* cache )
+{
+#ifndef GLSF_NO_THREADS
+    if(cache->running) {
+        glsfLockMutex(&cache->mutex);
+        cache->quit = 1;
+        glsfSignalCond(&cache->cond);
+        glsfUnlockMutex(&cache->mutex);
+        glsfJoinThread(cache->thread);
+    }
+    glsfFreeCond(&cache->cond);
+#endif
+    // Copied, it is about to be freed with the cache.
+    GLSFallocator allocator = cache->allocator;
+    glsfFree(&allocator, cache->queue);
+    glsfFreeArena(&cache->arena);
+    glsfFreeArena(&cache->thread_arena);
+    
+    glsfFree(&allocator, cache->pixels);
+    glsfFree(&allocator, cache->shelves);
+    
+    uint32_t i, j;
+    for(i = 0; i < GLSF_MAX_CHUNKS && cache->chunks[i]; ++i)
+        glsfFree(&allocator, cache->chunks[i]);
+    
+    for(i = 0; i < 65536 / GLSF_OUTLINE_CHUNK; ++i) {
+        for(j = 0; cache->outlines[i] && j < GLSF_OUTLINE_CHUNK; ++j)
+            glsfFree(&allocator, cache->outlines[i][j]);
+        glsfFree(&allocator, cache->outlines[i]);
+    }
+    
+    while(cache->table) {
+        GLSFglyphtable* next = cache->table->next;
+        glsfFree(&allocator, cache->table->slots);
+        glsfFree(&allocator, cache->table);
+        cache->table = next;
+    }
+    
+    glsfFreeMutex(&cache->mutex);
+    glsfReleaseFace(cache->face);
+    glsfFree(&allocator, cache);
+}
+
+/**
+ * @fn glsfLoadFace
+ * @brief Reads a font file, allocating through allocator, NULL for
+ *        malloc. The caller holds the one reference.
+ */
+static GLSFface* glsfLoadFace( const char* filename, 
+                               const GLSFallocator* allocator )
+{
+    // Read file.
+    FILE* file = fopen(filename, "rb");
+    if(!file) {
+        fprintf(stderr, "Failed opening \"%s\".\n", filename);
+        return NULL;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    size_t filesize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t* buffer = (uint8_t*)glsfAlloc(allocator, filesize);
+    if(!buffer) {
+        fprintf(stderr, "Failed allocating file buffer.\n");
+        fclose(file);
+        return NULL;
+    }
+    fread(buffer, 1, filesize, file);
+    fclose(file);
+    
+    GLSFface* face = (GLSFface*)glsfAlloc(allocator, sizeof(GLSFface));
+    if(!face) {
+        glsfFree(allocator, buffer);
+        return NULL;
+    }
+    memset(face, 0, sizeof(GLSFface));
+    if(allocator)
+        face->allocator = *allocator;
+    face->data = buffer;
+    face->refs = 1;
+    glsfInitArena(&face->arena, allocator);
+    face->arena.passthrough = GL_TRUE;
+    
+    if(!stbtt_InitFont(&face->info, buffer, 0)) {
+        fprintf(stderr, "Failed initializing font.\n");
+        glsfReleaseFace(face);
+        return NULL;
+    }
+    face->info.userdata = &face->arena;
+    
+    stbtt_GetFontVMetrics(&face->info, &face->ascent,
+                          &face->descent, &face->linegap);
+    return face;
+}
+
+/**
+ * @fn glsfRetainFace
+ * @brief Takes another reference to a face, returns it.
+ */
+static GLSFface* glsfRetainFace( GLSFface* face )
+{
+    glsfAddCount(&face->refs, 1);
+    return face;
+}
+
+/**
+ * @fn glsfReleaseFace
+ * @brief Drops a reference to a face, freeing it with the last one.
+ */
+static void glsfReleaseFace( GLSFface* face )
+{
+    if(glsfAddCount(&face->refs, -1) != 0)
+        return;
+    
+    // Copied, it is about to be freed with the face.
+    GLSFallocator allocator = face->allocator;
+    glsfFree(&allocator, face->data);
+    glsfFree(&allocator, face);
+}
+
+/**
+ * @fn glsfCreateFontFace
+ * @brief Creates a font of face at size, taking a reference to the face.
+ *        Allocates like the face, fonts of any size made from one face
+ *        share its file data.
+ */
+static GLSFfont* glsfCreateFontFace( GLSFface* face, float size, 
+                                     const char* pre )
+{
+    // Create and initialize the glyph cache.
+    GLSFcache* cache = (GLSFcache*)glsfAlloc(&face->allocator, sizeof(GLSFcache));
+    if(!cache)
+        return NULL;
+    memset(cache, 0, sizeof(GLSFcache));
+    cache->allocator = face->allocator;
+    glsfInitArena(&cache->arena, &cache->allocator);
+    glsfInitArena(&cache->thread_arena, &cache->allocator);
+    glsfInitMutex(&cache->mutex);
+#ifndef GLSF_NO_THREADS
+    glsfInitCond(&cache->cond);
+#endif
+    cache->face = glsfRetainFace(face);
+    cache->size = size;
+    cache->oversample_x = cache->oversample_y = 1;
+    
+    // Room for a few dozen glyphs per shelf, the height grows as needed.
+    cache->atlas_width = 256;
+    while(cache->atlas_width < size * 32 && cache->atlas_width < 4096)
+        cache->atlas_width *= 2;
+    
+    GLSFfont* new_font = glsfNewFont(cache);
+    if(!new_font) {
+        glsfFreeCache(cache);
+        return NULL;
+    }
+
+    // Preload some glyphs.
+    if(strlen(pre) > 0) {
+        uint32_t state, codepoint;
+        uint32_t i;
+        for(state = UTF8_ACCEPT, i = 0; i < strlen(pre); ++i) {
+            if(decutf8(&state, &codepoint, (uint8_t)pre[i]))
+                continue;
+            glsfGetGlyph(new_font, codepoint);
+        }
+        glsfSyncFont(new_font);
+    }
+    
+    return new_font;
+}
+
+/**
+ * @fn glsfCreateFontEx
+ * @brief Creates a font allocating through allocator, NULL for malloc.
+ *        It is copied, fonts shared with this one use it too.
+ */
+static GLSFfont* glsfCreateFontEx( const char* filename, float size,
+                                   const char* pre, 
+                                   const GLSFallocator* allocator )
+{
+    GLSFface* face = glsfLoadFace(filename, allocator);
+    if(!face)
+        return NULL;
+    
+    // The font's cache holds the only reference from here on.
+    GLSFfont* new_font = glsfCreateFontFace(face, size, pre);
+    glsfReleaseFace(face);
+    return new_font;
+}
+
+/**
+ * @fn glsfCreateFont
+ */
+static GLSFfont* glsfCreateFont( const char* filename, float size,
+                                 const char* pre )
+{
+    return glsfCreateFontEx(filename, size, pre, NULL);
+}
+
+/**
+ * @fn glsfCreateFontShared
+ * @brief Creates a font sharing the glyphs of another, to be drawn in a
+ *        different context or thread. Glyphs either one loads are usable
+ *        by both, each uploads them to its own texture when drawing.
+ */
+static GLSFfont* glsfCreateFontShared( GLSFfont* font )
+{
+    return glsfNewFont(font->cache);
+}
+
+/**
+ * @fn glsfDestroyFont
+ * @brief Frees a font, and its glyph cache with the last font using it.
+ */
+static void glsfDestroyFont( GLSFfont* font )
+{
+    glsfFreeTexture(font, &font->texture);
+#ifndef GLSF_NO_GL
+    glsfFreeState(&font->default_state);
+#endif
+    glsfFreeBatch(&font->batch);
+    
+    GLSFcache* cache = font->cache;
+    glsfFree(&cache->allocator, font);
+    if(glsfAddCount(&cache->refs, -1) == 0)
+        glsfFreeCache(cache);
+}
+
+/**
+ * @fn glsfGrowArray
+ * @brief Makes room for at least count elements, doubling the capacity.
+ */
+static int32_t glsfGrowArray( const GLSFallocator* allocator, void** array, 
+                              size_t* max, size_t count, size_t size )
+{
+    if(count <= *max)
+        return GL_TRUE;
+    
+    size_t new_max = *max ? *max * 2 : 16;
+    while(new_max < count)
+        new_max *= 2;
+    
+    void* new_array = glsfRealloc(allocator, *array, new_max * size);
+    if(!new_array)
+        return GL_FALSE;
+    
+    *array = new_array;
+    *max = new_max;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfInitBatch
+ */
+static void glsfInitBatch( GLSFbatch* batch )
+{
+    memset(batch, 0, sizeof(GLSFbatch));
+}
+
+/**
+ * @fn glsfFreeBatch
+ */
+static void glsfFreeBatch( GLSFbatch* batch )
+{
+    GLSFallocator allocator = batch->allocator;
+    glsfFree(&allocator, batch->instances);
+    glsfFree(&allocator, batch->layouts);
+    glsfFree(&allocator, batch->cached);
+    glsfFree(&allocator, batch->bytes);
+    glsfInitBatch(batch);
+    batch->allocator = allocator;
+}
+
+/**
+ * @fn glsfPackColor
+ * @brief Clamps a color to 0..1 and scales it to bytes.
+ */
+static void glsfPackColor( const float color[4], uint8_t packed[4] )
+{
+    int32_t i;
+    for(i = 0; i < 4; ++i) {
+        float c = color[i] < 0 ? 0 : (color[i] > 1 ? 1 : color[i]);
+        packed[i] = (uint8_t)(c * 255.0f + 0.5f);
+    }
+}
+
+/**
+ * @fn glsfBatchGlyph
+ * @brief Adds an instance for a glyph in batch's instance array.
+ */
+static void glsfBatchGlyph( GLSFbatch* batch, const GLSFglyphrecord* glyph, 
+                            float x, float y, const float color[4] )
+{
+    if(batch->num_instances + 1 > batch->max_instances)
+        return;
+
+    GLSFinstance* instance = &batch->instances[batch->num_instances++];
+    GLSF_STAT_ADD(batch, quads_emitted, 1);
+    
+    // Quad top left in pixels, zero is top. The highest glyph's height
+    // doubles as baseline offset, glyph->x0 and glyph->y0 are the offsets
+    // of the bbox from the pen.
+    instance->x = x + glyph->x0;
+    instance->y = y + (float)glsfLoadCount(&batch->font->cache->height) + glyph->y0;
+    
+    // Glyph rect in texture, normalized when drawn.
+    instance->s = glyph->s;
+    instance->t = glyph->t;
+    instance->w = glyph->w;
+    instance->h = glyph->h;
+    
+    glsfPackColor(color, instance->color);
+}
+
+/**
+ * @fn glsfLayoutString
+ * @brief Lays out at most length bytes of a string with the batch's font,
+ *        adding an instance for each character.
+ */
+static void glsfLayoutString( GLSFbatch* batch, const float rect[4],
+                              const float color[4], const char* string,
+                              size_t length )
+{
+    GLSFfont* font = batch->font;
+    double start = GLSF_STAT_TIME(), miss_time = 0;
+    
+    // Vertical advance, also the baseline's offset from the line's top.
+    float adv_y = (float)glsfLoadCount(&font->cache->height);
+    
+    // Clip edges, culling nothing without a clip.
+    float left = -1e30f, top = -1e30f, right = 1e30f, bottom = 1e30f;
+    if(batch->clipping) {
+        left = batch->clip[0];
+        top = batch->clip[1];
+        right = batch->clip[0] + batch->clip[2];
+        bottom = batch->clip[1] + batch->clip[3];
+    }
+    
+    // Add glyphs to instance array.
+    size_t i;
+    uint32_t state, codepoint;
+    float cur_x = 0, cur_y = 0;
+    for(state = UTF8_ACCEPT, i = 0; i < length && string[i]; ++i) {
+        // Lines only go down, once one starts below the clip the rest of
+        // the string is skipped. Glyphs may reach a line above their own.
+        if(rect[1] + cur_y - adv_y >= bottom)
+            break;
+        
+        if(decutf8(&state, &codepoint, *((uint8_t*)&string[i])))
+            continue;
+        
+        // Handle newlines.
+        if(codepoint == '\n') {
+            cur_x = 0;
+            cur_y += adv_y;
+            continue;
+        }
+        
+        GLSFglyphrecord* glyph = glsfLookupGlyph(font->cache, codepoint, 0);
+        if(glyph && !glyph->pending) {
+            GLSF_STAT_ADD(batch, glyph_hits, 1);
+        } else {
+            GLSF_STAT_ADD(batch, glyph_misses, 1);
+            double miss_start = GLSF_STAT_TIME();
+            if(font->async == GLSF_ASYNC_BLOCK)
+                glyph = glsfGetGlyph(font, codepoint);
+            else
+                glyph = glsfRequestGlyph(font, codepoint);
+            miss_time += GLSF_STAT_TIME() - miss_start;
+        }
+        if(!glyph || glyph->missing)
+            continue;
+        
+        // Ignore space after newline.
+        if(cur_x == 0 && glyph->codepoint == ' ')
+            continue;
+        
+        // Horizontal Advance.
+        float adv_x = glyph->advance;
+        
+        // Handle linebreaking, a glyph wider than the rect gets its own.
+        if(cur_x > 0 && cur_x + adv_x > rect[2]) {
+            cur_x = 0;
+            cur_y += adv_y;
+            if(glyph->codepoint == ' ')
+                continue;
+        }
+        
+        // Glyphs outside the clip only move the pen. Subpixel variants
+        // may be a pixel wider.
+        float x = cur_x + rect[0], y = cur_y + rect[1];
+        if(x + glyph->x0 - 1 >= right || x + glyph->x0 + glyph->w + 1 <= left ||
+           y + adv_y + glyph->y0 >= bottom || y + adv_y + glyph->y0 + glyph->h <= top) {
+            GLSF_STAT_ADD(batch, glyphs_culled, 1);
+            cur_x += adv_x;
+            continue;
+        }
+        
+        // Room for the rest of the string at most, a byte per glyph.
+        if(batch->num_instances == batch->max_instances) {
+            size_t rest = 0;
+            while(rest < length - i && string[i + rest])
+                rest++;
+            if(glsfGrowArray(&batch->allocator, (void**)&batch->instances, &batch->max_instances, 
+                             batch->num_instances + rest, 
+                             sizeof(GLSFinstance)) == GL_FALSE)
+                break;
+            GLSF_STAT_ADD(batch, array_growths, 1);
+        }
+        
+        // Draw from a whole pixel with the variant shifted closest to the
+        // fraction left over. Until a queued variant is ready the glyph
+        // is drawn unshifted from the nearest pixel.
+        if(font->phases > 1 && !glyph->pending && glyph->w > 0) {
+            float whole = floorf(x);
+            int32_t step = (int32_t)((x - whole) * font->phases + 0.5f);
+            x = whole;
+            if(step == (int32_t)font->phases) {
+                x += 1;
+                step = 0;
+            }
+            if(step != 0) {
+                int32_t phase = step * 64 / (int32_t)font->phases;
+                GLSFglyphrecord* variant = glsfLookupGlyph(font->cache, codepoint, phase);
+                if(variant && !variant->pending) {
+                    GLSF_STAT_ADD(batch, glyph_hits, 1);
+                } else {
+                    GLSF_STAT_ADD(batch, glyph_misses, 1);
+                    double miss_start = GLSF_STAT_TIME();
+                    if(font->async == GLSF_ASYNC_BLOCK)
+                        variant = glsfGetVariant(font, codepoint, phase);
+                    else
+                        variant = glsfRequestVariant(font, codepoint, phase);
+                    miss_time += GLSF_STAT_TIME() - miss_start;
+                }
+                if(variant && !variant->pending)
+                    glyph = variant;
+                else if(step * 2 >= (int32_t)font->phases)
+                    x += 1;
+            }
+        }
+        
+        // Keep the space of a glyph still being loaded.
+        if(glyph->pending) {
+            GLSFglyphrecord* tofu = (GLSFglyphrecord*)glsfLoadPointer(&font->cache->tofu);
+            if(font->async == GLSF_ASYNC_TOFU && tofu)
+                glsfBatchGlyph(batch, tofu, x, y, color);
+        } else {
+            glsfBatchGlyph(batch, glyph, x, y, color);
+        }
+        
+        // Advance cursor.
+        cur_x += adv_x;
+    }
+    
+    GLSF_STAT_ADD(batch, layout_time, GLSF_STAT_TIME() - start - miss_time);
+}
+
+/**
+ * @fn glsfHashString
+ * @brief FNV-1a hash of at most length bytes of a string, length is set
+ *        to the bytes hashed.
+ */
+static uint64_t glsfHashString( const char* string, size_t* length )
+{
+    uint64_t hash = 14695981039346656037ull;
+    size_t i;
+    for(i = 0; i < *length && string[i]; ++i) {
+        hash ^= *((uint8_t*)&string[i]);
+        hash *= 1099511628211ull;
+    }
+    *length = i;
+    return hash;
+}
+
+/**
+ * @fn glsfFindLayout
+ * @brief The slot of a layout of string in a batch's cache or the empty
+ *        slot it would go in.
+ */
+static GLSFlayout* glsfFindLayout( GLSFbatch* batch, const GLSFlayout* key,
+                                   const char* string )
+{
+    size_t mask = batch->max_layouts - 1, i;
+    for(i = (size_t)key->hash; ; ++i) {
+        GLSFlayout* layout = &batch->layouts[i & mask];
+        if(layout->used == 0 ||
+           (layout->hash == key->hash && layout->length == key->length &&
+            layout->font == key->font && layout->width == key->width &&
+            layout->fraction == key->fraction &&
+            memcmp(layout->color, key->color, sizeof(key->color)) == 0 &&
+            memcmp(batch->bytes + layout->offset, string, key->length) == 0))
+            return layout;
+    }
+}
+
+/**
+ * @fn glsfRehashLayouts
+ * @brief Moves a batch's layouts used within its last keep frames to a
+ *        new table at most a quarter full, and their instances and bytes
+ *        to new arrays. The rest are dropped.
+ */
+static int32_t glsfRehashLayouts( GLSFbatch* batch )
+{
+    size_t num_layouts = 0, count = 0, length = 0, size = 64, i;
+    for(i = 0; i < batch->max_layouts; ++i) {
+        GLSFlayout* layout = &batch->layouts[i];
+        if(layout->used && batch->frame - layout->used <= batch->keep) {
+            num_layouts++;
+            count += layout->count;
+            length += layout->length;
+        }
+    }
+    while(size < num_layouts * 4)
+        size *= 2;
+    
+    GLSFlayout* layouts = (GLSFlayout*)glsfAlloc(&batch->allocator, sizeof(GLSFlayout) * size);
+    GLSFinstance* cached = (GLSFinstance*)glsfAlloc(&batch->allocator, 
+                                                    sizeof(GLSFinstance) * (count ? count : 1));
+    char* bytes = (char*)glsfAlloc(&batch->allocator, length ? length : 1);
+    if(!layouts || !cached || !bytes) {
+        glsfFree(&batch->allocator, layouts);
+        glsfFree(&batch->allocator, cached);
+        glsfFree(&batch->allocator, bytes);
+        return GL_FALSE;
+    }
+    memset(layouts, 0, sizeof(GLSFlayout) * size);
+    
+    GLSFlayout* old = batch->layouts;
+    char* old_bytes = batch->bytes;
+    size_t old_size = batch->max_layouts;
+    batch->layouts = layouts;
+    batch->max_layouts = size;
+    batch->num_layouts = 0;
+    batch->bytes = bytes;
+    
+    size_t num_cached = 0, num_bytes = 0;
+    for(i = 0; i < old_size; ++i) {
+        GLSFlayout* layout = &old[i];
+        if(!layout->used || batch->frame - layout->used > batch->keep)
+            continue;
+        
+        GLSFlayout* slot = glsfFindLayout(batch, layout, old_bytes + layout->offset);
+        *slot = *layout;
+        slot->first = num_cached;
+        slot->offset = num_bytes;
+        memcpy(cached + num_cached, batch->cached + layout->first, 
+               sizeof(GLSFinstance) * layout->count);
+        memcpy(bytes + num_bytes, old_bytes + layout->offset, layout->length);
+        num_cached += layout->count;
+        num_bytes += layout->length;
+        batch->num_layouts++;
+    }
+    
+    glsfFree(&batch->allocator, old);
+    glsfFree(&batch->allocator, old_bytes);
+    glsfFree(&batch->allocator, batch->cached);
+    batch->cached = cached;
+    batch->num_cached = num_cached;
+    batch->max_cached = count ? count : 1;
+    batch->num_bytes = num_bytes;
+    batch->max_bytes = length ? length : 1;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfAgeLayouts
+ * @brief Counts a frame for a batch's layout cache. Layouts not used for
+ *        keep frames are dropped once most cached instances are unused.
+ */
+static void glsfAgeLayouts( GLSFbatch* batch )
+{
+    batch->frame++;
+    
+    size_t live = 0, i;
+    for(i = 0; i < batch->max_layouts; ++i) {
+        GLSFlayout* layout = &batch->layouts[i];
+        if(layout->used && batch->frame - layout->used <= batch->keep)
+            live += layout->count;
+    }
+    if(live * 2 < batch->num_cached)
+        glsfRehashLayouts(batch);
+}
+
+/**
+ * @fn glsfBatchStringN
+ * @brief Lays out at most length bytes of a string with the batch's font,
+ *        adding an instance for each character. With a layout cache an
+ *        earlier layout of the string is copied instead when it can be.
+ */
+static void glsfBatchStringN( GLSFbatch* batch, const float rect[4],
+                              const float color[4], const char* string,
+                              size_t length )
+{
+    GLSFfont* font = batch->font;
+    
+    // What is culled depends on where the string is, clipped strings
+    // are laid out every time.
+    if(batch->keep == 0 || batch->clipping) {
+        glsfLayoutString(batch, rect, color, string, length);
+        return;
+    }
+    
+    double start = GLSF_STAT_TIME();
+    
+    // Subpixel variants depend on where in a pixel the string starts.
+    GLSFlayout key;
+    memset(&key, 0, sizeof(GLSFlayout));
+    key.font = font;
+    key.hash = glsfHashString(string, &length);
+    key.length = length;
+    key.width = rect[2];
+    key.fraction = font->phases > 1 ? rect[0] - floorf(rect[0]) : 0;
+    glsfPackColor(color, key.color);
+    key.generation = glsfLoadCount(&font->cache->num_glyphs);
+    
+    GLSFlayout* layout = batch->max_layouts ? glsfFindLayout(batch, &key, string) : NULL;
+    if(layout && layout->used && layout->generation == key.generation) {
+        size_t max = batch->max_instances;
+        if(glsfGrowArray(&batch->allocator, (void**)&batch->instances, &batch->max_instances, 
+                         batch->num_instances + layout->count, 
+                         sizeof(GLSFinstance)) == GL_FALSE)
+            return;
+        if(batch->max_instances != max)
+            GLSF_STAT_ADD(batch, array_growths, 1);
+        
+        // Moved to where the string is now.
+        float dx = rect[0] - layout->x, dy = rect[1] - layout->y;
+        const GLSFinstance* cached = batch->cached + layout->first;
+        GLSFinstance* instance = batch->instances + batch->num_instances;
+        size_t i;
+        for(i = 0; i < layout->count; ++i) {
+            instance[i] = cached[i];
+            instance[i].x += dx;
+            instance[i].y += dy;
+        }
+        batch->num_instances += layout->count;
+        layout->used = batch->frame;
+        
+        GLSF_STAT_ADD(batch, layouts_reused, 1);
+        GLSF_STAT_ADD(batch, quads_emitted, layout->count);
+        GLSF_STAT_ADD(batch, layout_time, GLSF_STAT_TIME() - start);
+        return;
+    }
+    
+    size_t first = batch->num_instances;
+    glsfLayoutString(batch, rect, color, string, length);
+    size_t count = batch->num_instances - first;
+    
+    // Keep the table at most half full.
+    if(!layout || (!layout->used && (batch->num_layouts + 1) * 2 > batch->max_layouts)) {
+        if(glsfRehashLayouts(batch) == GL_FALSE)
+            return;
+        layout = glsfFindLayout(batch, &key, string);
+    }
+    if(glsfGrowArray(&batch->allocator, (void**)&batch->cached, &batch->max_cached, 
+                     batch->num_cached + count, sizeof(GLSFinstance)) == GL_FALSE ||
+       glsfGrowArray(&batch->allocator, (void**)&batch->bytes, &batch->max_bytes, 
+                     batch->num_bytes + length, 1) == GL_FALSE)
+        return;
+    
+    if(!layout->used)
+        batch->num_layouts++;
+    *layout = key;
+    layout->offset = batch->num_bytes;
+    memcpy(batch->bytes + batch->num_bytes, string, length);
+    batch->num_bytes += length;
+    layout->first = batch->num_cached;
+    layout->count = count;
+    layout->x = rect[0];
+    layout->y = rect[1];
+    layout->used = batch->frame;
+    memcpy(batch->cached + batch->num_cached, batch->instances + first, 
+           sizeof(GLSFinstance) * count);
+    batch->num_cached += count;
+}
+
+/**
+ * @fn glsfBatchString
+ * @brief Lays out a string with the batch's font, adding an instance
+ *        for each character.
+ */
+static void glsfBatchString( GLSFbatch* batch, const float rect[4],
+                             const float color[4], const char* string )
+{
+    glsfBatchStringN(batch, rect, color, string, (size_t)-1);
+}
+
+/**
+ * @fn glsfFlushStats
+ * @brief Adds a batch's layout counters to its font's and clears them.
+ */
+static void glsfFlushStats( GLSFfont* font, GLSFbatch* batch )
+{
+#ifndef GLSF_NO_STATS
+    // Layout counters are kept in the batch until drawn, so building
+    // batches for a font on several threads does not race on them.
+    GLSFstats* stats = &font->stats;
+    stats->glyph_hits += batch->stats.glyph_hits;
+    stats->glyph_misses += batch->stats.glyph_misses;
+    stats->quads_emitted += batch->stats.quads_emitted;
+    stats->draw_calls += batch->stats.draw_calls;
+    stats->array_growths += batch->stats.array_growths;
+    stats->glyphs_culled += batch->stats.glyphs_culled;
+    stats->layouts_reused += batch->stats.layouts_reused;
+    stats->layout_time += batch->stats.layout_time;
+    memset(&batch->stats, 0, sizeof(GLSFstats));
+#else
+    (void)font;
+    (void)batch;
+#endif
+}
+
+/**
+ * @fn glsfDrawBatch
+ * @brief Uploads new glyphs, draws a batch's instances with its font and
+ *        empties it. Must be called in the context owning the font's
+ *        texture.
+ */
+static void glsfDrawBatch( GLSFbatch* batch )
+{
+    GLSFfont* font = batch->font;
+    if(batch->keep)
+        glsfAgeLayouts(batch);
+    
+    if(!font)
+        return;
+
+    // Anything to be drawn? Nothing is visible until some glyph has
+    // pixels, spaces have none. What layout counted is kept either way.
+    if(batch->num_instances > 0 && glsfSyncFont(font) == GL_TRUE && 
+       font->texture.width > 0) {
+        GLSFtraceevent event = { "glsfDrawFont", 0, (uint32_t)batch->num_instances, 0, 0.0 };
+        GLSF_TRACE(font, begin, &event);
+        
+        GLSFdraw draw;
+        draw.texture = &font->texture;
+        draw.instances = batch->instances;
+        draw.num_instances = batch->num_instances;
+        draw.offset[0] = draw.offset[1] = 0;
+        if(font->backend.draw)
+            font->backend.draw(font->backend.user, &draw);
+        GLSF_STAT_ADD(batch, draw_calls, 1);
+        
+        GLSF_TRACE(font, end, &event);
+    }
+    glsfFlushStats(font, batch);
+    
+    // Mark instances drawn.
+    batch->num_instances = 0;
+}
+
+/**
+ * @fn glsfBatchClip
+ * @brief Leave out glyphs falling outside a rect (x, y, width, height in
+ *        the pixels strings are laid out in) from now on, NULL to stop.
+ *        Give it the viewport, 0, 0, width, height, to skip text
+ *        scrolled out of view, or a panel's rect. Lines below it are not
+ *        laid out at all. Glyphs partly inside are drawn whole.
+ */
+static void glsfBatchClip( GLSFbatch* batch, const float rect[4] )
+{
+    batch->clipping = rect != NULL;
+    if(rect)
+        memcpy(batch->clip, rect, sizeof(batch->clip));
+}
+
+/**
+ * @fn glsfBatchCache
+ * @brief Copies the layout of a string laid out again with the same
+ *        width and color, and no glyph loaded since, from the last frames
+ *        draws of the batch, moved to its rect. 0 stops caching and
+ *        frees what was kept. Clipped strings are laid out every time.
+ */
+static void glsfBatchCache( GLSFbatch* batch, uint32_t frames )
+{
+    batch->keep = frames;
+    if(frames == 0) {
+        glsfFree(&batch->allocator, batch->layouts);
+        glsfFree(&batch->allocator, batch->cached);
+        glsfFree(&batch->allocator, batch->bytes);
+        batch->layouts = NULL;
+        batch->cached = NULL;
+        batch->bytes = NULL;
+        batch->num_layouts = batch->max_layouts = 0;
+        batch->num_cached = batch->max_cached = 0;
+        batch->num_bytes = batch->max_bytes = 0;
+    } else if(batch->frame == 0) {
+        batch->frame = 1;
+    }
+}
+
+/**
+ * @fn glsfBatchBegin
+ * @brief Starts building a batch of strings for a font.
+ */
+static void glsfBatchBegin( GLSFbatch* batch, GLSFfont* font )
+{
+    // Instances laid out for another font are meaningless for this one.
+    if(batch->font != font)
+        batch->num_instances = 0;
+    batch->font = font;
+}
+
+/**
+ * @fn glsfBatchEnd
+ * @brief Draws everything added since glsfBatchBegin.
+ */
+static void glsfBatchEnd( GLSFbatch* batch )
+{
+    glsfDrawBatch(batch);
+    batch->font = NULL;
+}
+
+/**
+ * @fn glsfEnqueueGlyph
+ * @brief Adds an instance for a glyph in font's own batch.
+ */
+static void glsfEnqueueGlyph( GLSFfont* font, const GLSFglyphrecord* glyph, 
+                              float x, float y, const float color[4] )
+{
+    glsfBatchGlyph(&font->batch, glyph, x, y, color);
+}
+
+/**
+ * @fn glsfEnqueueString
+ * @brief Prepare a string to be drawn for font by calling EnqueueGlyph
+ *        for each character.
+ */
+static void glsfEnqueueString( GLSFfont* font, const float rect[4],
+                               const float color[4], const char* string )
+{
+    glsfBatchString(&font->batch, rect, color, string);
+}
+
+/**
+ * @fn glsfEnqueueStringN
+ * @brief Like glsfEnqueueString for at most length bytes of a string, no
+ *        terminator needed.
+ */
+static void glsfEnqueueStringN( GLSFfont* font, const float rect[4],
+                                const float color[4], const char* string,
+                                size_t length )
+{
+    glsfBatchStringN(&font->batch, rect, color, string, length);
+}
+
+/**
+ * @fn glsfSetClip
+ * @brief Sets the clip of font's own batch, see glsfBatchClip.
+ */
+static void glsfSetClip( GLSFfont* font, const float rect[4] )
+{
+    glsfBatchClip(&font->batch, rect);
+}
+
+/**
+ * @fn glsfSetLayoutCache
+ * @brief Caches layouts in font's own batch, see glsfBatchCache.
+ */
+static void glsfSetLayoutCache( GLSFfont* font, uint32_t frames )
+{
+    glsfBatchCache(&font->batch, frames);
+}
+
+/**
+ * @fn glsfDrawFont
+ * @brief Draws a font's instances after some calls to EnqueueString.
+ */
+static void glsfDrawFont( GLSFfont* font )
+{
+    glsfDrawBatch(&font->batch);
+}
+
+/**
+ * @fn glsfDrawString
+ */
+static void glsfDrawString( GLSFfont* font, const float rect[4], 
+                            const float color[4], const char* string )
+{
+    glsfEnqueueString(font, rect, color, string);
+    glsfDrawFont(font);
+}
+
+/**
+ * @fn glsfGetBatch
+ * @brief The calling thread's batch used by glsfBegin, glsfString and
+ *        glsfEnd. Each thread (and translation unit) gets its own, free
+ *        it with glsfFreeBatch before the thread exits.
+ */
+static GLSFbatch* glsfGetBatch()
+{
+    return &_glsf_batch;
+}
+
+/**
+ * @fn glsfBegin
+ */
+static void glsfBegin( GLSFfont* font )
+{
+    glsfBatchBegin(&_glsf_batch, font);
+}
+
+/**
+ * @fn glsfEnd
+ */
+static void glsfEnd()
+{
+    glsfBatchEnd(&_glsf_batch);
+}
+
+/**
+ * @fn glsfString
+ */
+static void glsfString( const float rect[4], const float color[4],
+                        const char* string )
+{
+    glsfBatchString(&_glsf_batch, rect, color, string);
+}
+
+/**
+ * @fn glsfStringN
+ */
+static void glsfStringN( const float rect[4], const float color[4],
+                         const char* string, size_t length )
+{
+    glsfBatchStringN(&_glsf_batch, rect, color, string, length);
+}
+
+/**
+ * @fn glsfInitDocument
+ * @brief Starts an empty document for font wrapping lines at width.
+ */
+static void glsfInitDocument( GLSFdocument* document, GLSFfont* font, 
+                              float width )
+{
+    memset(document, 0, sizeof(GLSFdocument));
+    document->font = font;
+    document->width = width;
+    document->batch.font = font;
+}
+
+/**
+ * @fn glsfFreeDocument
+ */
+static void glsfFreeDocument( GLSFdocument* document )
+{
+    GLSFallocator allocator = document->allocator;
+    glsfFree(&allocator, document->text);
+    glsfFree(&allocator, document->lines);
+    glsfFree(&allocator, document->spans);
+    glsfFreeBatch(&document->batch);
+    memset(document, 0, sizeof(GLSFdocument));
+    document->allocator = allocator;
+}
+
+/**
+ * @fn glsfAppendDocument
+ * @brief Adds length bytes of text to the end of a document.
+ */
+static int32_t glsfAppendDocument( GLSFdocument* document, const char* text, 
+                                   size_t length )
+{
+    if(glsfGrowArray(&document->allocator, (void**)&document->text, &document->max_length,
+                     document->length + length, 1) == GL_FALSE)
+        return GL_FALSE;
+    
+    memcpy(document->text + document->length, text, length);
+    document->length += length;
+    
+    // The last line may go on, it is indexed and laid out again.
+    if(document->last >= document->num_lines)
+        document->first = document->last = 0;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfResizeDocument
+ * @brief Wraps lines at another width, the index is built again.
+ */
+static void glsfResizeDocument( GLSFdocument* document, float width )
+{
+    document->width = width;
+    document->num_lines = 0;
+    document->indexed = 0;
+    document->first = document->last = 0;
+}
+
+/**
+ * @fn glsfMeasureLine
+ * @brief Finds where the first line of a text ends when laid out at width
+ *        by glsfBatchStringN. Returns the bytes up to the next line's
+ *        start, 0 if the line runs to the end of the text.
+ */
+static size_t glsfMeasureLine( GLSFfont* font, const char* text, 
+                               size_t length, float width )
+{
+    size_t i, begin = 0;
+    uint32_t state, codepoint;
+    float cur_x = 0;
+    for(state = UTF8_ACCEPT, i = 0; i < length && text[i]; ++i) {
+        if(decutf8(&state, &codepoint, *((uint8_t*)&text[i])))
+            continue;
+        
+        // First byte of this character, where a wrapped line starts.
+        size_t at = begin;
+        begin = i + 1;
+        
+        if(codepoint == '\n')
+            return i + 1;
+        
+        // Only metrics are needed, pending glyphs already have them.
+        GLSFglyphrecord* glyph = glsfLookupGlyph(font->cache, codepoint, 0);
+        if(!glyph) {
+            if(font->async == GLSF_ASYNC_BLOCK)
+                glyph = glsfGetGlyph(font, codepoint);
+            else
+                glyph = glsfRequestGlyph(font, codepoint);
+        }
+        if(!glyph || glyph->missing)
+            continue;
+        
+        if(cur_x == 0 && glyph->codepoint == ' ')
+            continue;
+        
+        float adv_x = glyph->advance;
+        if(cur_x > 0 && cur_x + adv_x > width)
+            return at;
+        cur_x += adv_x;
+    }
+    
+    return 0;
+}
+
+/**
+ * @fn glsfIndexDocument
+ * @brief Indexes lines until lines of them are known or the text ends.
+ *        Drawing indexes what it shows, call this to find the height of
+ *        the whole text ahead of time, a bit each frame for long ones.
+ */
+static int32_t glsfIndexDocument( GLSFdocument* document, size_t lines )
+{
+    if(document->num_lines == 0) {
+        if(glsfGrowArray(&document->allocator, (void**)&document->lines, 
+                         &document->max_lines, 1, sizeof(size_t)) == GL_FALSE)
+            return GL_FALSE;
+        document->lines[document->num_lines++] = 0;
+    }
+    
+    // Measure on from the start of the last line known, it may have grown.
+    while(document->num_lines < lines && document->indexed < document->length) {
+        size_t start = document->lines[document->num_lines - 1];
+        size_t next = glsfMeasureLine(document->font, document->text + start, 
+                                      document->length - start, document->width);
+        if(next == 0) {
+            document->indexed = document->length;
+            break;
+        }
+        next += start;
+        
+        if(glsfGrowArray(&document->allocator, (void**)&document->lines, &document->max_lines, 
+                         document->num_lines + 1, sizeof(size_t)) == GL_FALSE)
+            return GL_FALSE;
+        document->lines[document->num_lines++] = next;
+        document->indexed = next;
+    }
+    
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfLayoutDocument
+ * @brief Lays out lines first to last and as many again above and below,
+ *        each from its own top so moving them is enough to scroll.
+ */
+static int32_t glsfLayoutDocument( GLSFdocument* document, size_t first, 
+                                   size_t last, float height, 
+                                   const float color[4] )
+{
+    size_t count = last - first;
+    size_t lo = first > count ? first - count : 0;
+    size_t hi = last + count;
+    if(glsfIndexDocument(document, hi) == GL_FALSE)
+        return GL_FALSE;
+    if(hi > document->num_lines)
+        hi = document->num_lines;
+    
+    if(glsfGrowArray(&document->allocator, (void**)&document->spans, &document->max_spans, 
+                     hi - lo + 1, sizeof(size_t)) == GL_FALSE)
+        return GL_FALSE;
+    if(!document->batch.instances)
+        document->batch.allocator = document->allocator;
+    
+    // Line positions are kept small, relative to the first laid out.
+    float rect[4] = { 0, 0, document->width, height };
+    document->batch.num_instances = 0;
+    size_t n;
+    for(n = lo; n < hi; ++n) {
+        size_t start = document->lines[n];
+        size_t end = n + 1 < document->num_lines ? document->lines[n + 1] : document->length;
+        document->spans[n - lo] = document->batch.num_instances;
+        rect[1] = (float)(n - lo) * height;
+        glsfBatchStringN(&document->batch, rect, color, document->text + start, end - start);
+    }
+    document->spans[hi - lo] = document->batch.num_instances;
+    
+    document->first = lo;
+    document->last = hi;
+    document->height = height;
+    memcpy(document->color, color, sizeof(document->color));
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfDrawDocument
+ * @brief Draws the lines of a document in view in rect (x, y, width,
+ *        height) scrolled scroll pixels down from its top. Lines partly
+ *        in view are drawn whole, scissor to rect to cut them. Keep
+ *        rect's x on whole pixels with subpixel positioning. Must be
+ *        called in the context owning the font's texture.
+ */
+static void glsfDrawDocument( GLSFdocument* document, const float rect[4], 
+                              const float color[4], float scroll )
+{
+    GLSFfont* font = document->font;
+    
+    // The line height is known once some glyph is loaded.
+    float height = (float)glsfLoadCount(&font->cache->height);
+    while(height <= 0 && document->indexed < document->length) {
+        if(glsfIndexDocument(document, document->num_lines + 1) == GL_FALSE)
+            return;
+        height = (float)glsfLoadCount(&font->cache->height);
+    }
+    if(height <= 0 || scroll + rect[3] <= 0)
+        return;
+    
+    // Lines in view, descenders of the one above may reach into it.
+    size_t first = scroll > height ? (size_t)(scroll / height) - 1 : 0;
+    size_t last = (size_t)ceilf((scroll + rect[3]) / height);
+    if(glsfIndexDocument(document, last) == GL_FALSE)
+        return;
+    if(last > document->num_lines)
+        last = document->num_lines;
+    if(first >= last)
+        return;
+    
+    if(glsfSyncFont(font) == GL_FALSE)
+        return;
+    
+    // Lay out again when scrolled past what is laid out or when glyphs
+    // pending then have arrived.
+    if(first < document->first || last > document->last ||
+       document->height != height ||
+       memcmp(document->color, color, sizeof(document->color)) != 0 ||
+       (font->async != GLSF_ASYNC_BLOCK && document->synced != font->num_synced)) {
+        if(glsfLayoutDocument(document, first, last, height, color) == GL_FALSE ||
+           glsfSyncFont(font) == GL_FALSE)
+            return;
+        document->synced = font->num_synced;
+    }
+    
+    size_t begin = document->spans[first - document->first];
+    size_t end = document->spans[last - document->first];
+    if(end > begin && font->texture.width > 0) {
+        GLSFtraceevent event = { "glsfDrawDocument", 0, (uint32_t)(end - begin), 0, 0.0 };
+        GLSF_TRACE(font, begin, &event);
+        
+        GLSFdraw draw;
+        draw.texture = &font->texture;
+        draw.instances = document->batch.instances + begin;
+        draw.num_instances = end - begin;
+        draw.offset[0] = rect[0];
+        draw.offset[1] = rect[1] + (float)((double)document->first * height - scroll);
+        if(font->backend.draw)
+            font->backend.draw(font->backend.user, &draw);
+        GLSF_STAT_ADD(&document->batch, draw_calls, 1);
+        
+        GLSF_TRACE(font, end, &event);
+    }
+    glsfFlushStats(font, &document->batch);
+}
+
+/**
+ * @fn glsfInitConsole
+ * @brief Starts an empty console for font keeping at most lines lines
+ *        and glyphs glyphs, wrapping lines at width.
+ */
+static void glsfInitConsole( GLSFconsole* console, GLSFfont* font, 
+                             float width, size_t lines, size_t glyphs )
+{
+    memset(console, 0, sizeof(GLSFconsole));
+    console->font = font;
+    console->width = width;
+    console->max_lines = lines;
+    console->max_instances = glyphs;
+    console->batch.font = font;
+    
+    // Whole pixels, so glyphs stay on them.
+    GLSFface* face = font->cache->face;
+    float scale = stbtt_ScaleForPixelHeight(&face->info, font->cache->size);
+    console->height = ceilf((float)(face->ascent - face->descent + face->linegap) * scale);
+    console->baseline = floorf((float)face->ascent * scale + 0.5f);
+}
+
+/**
+ * @fn glsfFreeConsole
+ */
+static void glsfFreeConsole( GLSFconsole* console )
+{
+    GLSFallocator allocator = console->allocator;
+    glsfFree(&allocator, console->lines);
+    glsfFree(&allocator, console->instances);
+    glsfFreeBatch(&console->batch);
+    memset(console, 0, sizeof(GLSFconsole));
+    console->allocator = allocator;
+}
+
+/**
+ * @fn glsfClearConsole
+ * @brief Drops every line, keeping the memory.
+ */
+static void glsfClearConsole( GLSFconsole* console )
+{
+    console->first_line = console->num_lines = 0;
+    console->write = console->wrapped = 0;
+    console->base[0] = console->base[1] = console->rows;
+}
+
+/**
+ * @fn glsfDropConsoleLine
+ * @brief Drops the oldest line of a console.
+ */
+static void glsfDropConsoleLine( GLSFconsole* console )
+{
+    console->first_line = (console->first_line + 1) % console->max_lines;
+    console->num_lines--;
+}
+
+/**
+ * @fn glsfAppendConsole
+ * @brief Lays out a line at the bottom of a console. Glyphs are laid out
+ *        as they are when appended, those still loading in async modes
+ *        stay left out.
+ */
+static int32_t glsfAppendConsole( GLSFconsole* console, const float color[4],
+                                  const char* text )
+{
+    GLSFfont* font = console->font;
+    GLSFbatch* batch = &console->batch;
+    if(console->max_lines == 0 || console->max_instances == 0)
+        return GL_FALSE;
+    
+    if(!console->lines) {
+        console->lines = (GLSFconsoleline*)glsfAlloc(&console->allocator, 
+                                                     sizeof(GLSFconsoleline) * console->max_lines);
+        console->instances = (GLSFinstance*)glsfAlloc(&console->allocator, 
+                                                      sizeof(GLSFinstance) * console->max_instances);
+        batch->allocator = console->allocator;
+        if(!console->lines || !console->instances) {
+            glsfFree(&console->allocator, console->lines);
+            glsfFree(&console->allocator, console->instances);
+            console->lines = NULL;
+            console->instances = NULL;
+            return GL_FALSE;
+        }
+    }
+    
+    // Lay out a row at a time from the top of the line. Glyphs are laid
+    // out below the tallest loaded, again if one loads meanwhile, and
+    // moved up onto the baseline.
+    float rect[4] = { 0, 0, console->width, console->height };
+    size_t length = strlen(text), start = 0;
+    uint32_t rows = 0;
+    batch->num_instances = 0;
+    for(;;) {
+        size_t next = glsfMeasureLine(font, text + start, length - start, console->width);
+        size_t first = batch->num_instances, i;
+        float tallest;
+        rect[1] = console->height * rows++;
+        do {
+            batch->num_instances = first;
+            tallest = (float)glsfLoadCount(&font->cache->height);
+            glsfBatchStringN(batch, rect, color, text + start, next ? next : length - start);
+        } while(tallest != (float)glsfLoadCount(&font->cache->height));
+        for(i = first; i < batch->num_instances; ++i)
+            batch->instances[i].y += console->baseline - tallest;
+        if(next == 0)
+            break;
+        start += next;
+    }
+    size_t count = batch->num_instances;
+    if(count > console->max_instances)
+        count = console->max_instances;
+    
+    // Start the ring over when the line does not fit at its end. Lines
+    // are kept from one pass before at most. Rows are counted from where
+    // the pass started, staying small enough for exact floats.
+    if(console->write + count > console->max_instances ||
+       console->rows - console->base[console->epoch & 1] >= 65536) {
+        while(console->num_lines > 0 &&
+              console->lines[console->first_line].epoch != console->epoch)
+            glsfDropConsoleLine(console);
+        console->wrapped = console->write;
+        console->write = 0;
+        console->epoch++;
+        console->base[console->epoch & 1] = console->rows;
+    }
+    
+    // Drop lines of the pass before the new one overwrites.
+    while(console->num_lines > 0) {
+        GLSFconsoleline* oldest = &console->lines[console->first_line];
+        if(console->num_lines < console->max_lines &&
+           (oldest->epoch == console->epoch || oldest->first >= console->write + count))
+            break;
+        glsfDropConsoleLine(console);
+    }
+    
+    float y = (float)(console->rows - console->base[console->epoch & 1]) * console->height;
+    GLSFinstance* instance = console->instances + console->write;
+    size_t i;
+    for(i = 0; i < count; ++i) {
+        instance[i] = batch->instances[i];
+        instance[i].y += y;
+    }
+    
+    GLSFconsoleline* line = &console->lines[(console->first_line + console->num_lines++) % 
+                                            console->max_lines];
+    line->first = console->write;
+    line->count = count;
+    line->row = console->rows;
+    line->rows = rows;
+    line->epoch = console->epoch;
+    console->write += count;
+    console->rows += rows;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfDrawConsole
+ * @brief Draws as many of the newest lines as fit in rect (x, y, width,
+ *        height), the last at its bottom. The oldest shown is drawn whole.
+ *        Must be called in the context owning the font's texture.
+ */
+static void glsfDrawConsole( GLSFconsole* console, const float rect[4] )
+{
+    GLSFfont* font = console->font;
+    if(console->num_lines == 0 || console->height <= 0)
+        return;
+    
+    // Oldest line in view.
+    size_t shown = 0;
+    float top = rect[3];
+    while(shown < console->num_lines && top > 0) {
+        shown++;
+        top -= console->height * console->lines[(console->first_line + console->num_lines - shown) % 
+                                                console->max_lines].rows;
+    }
+    const GLSFconsoleline* oldest = &console->lines[(console->first_line + console->num_lines - shown) % 
+                                                    console->max_lines];
+    
+    if(glsfSyncFont(font) == GL_FALSE || font->texture.width == 0)
+        return;
+    
+    // Lines from the pass before, then those of this one.
+    size_t runs[2][2] = { { 0, 0 }, { 0, console->write } };
+    if(oldest->epoch != console->epoch) {
+        runs[0][0] = oldest->first;
+        runs[0][1] = console->wrapped;
+    } else {
+        runs[1][0] = oldest->first;
+    }
+    
+    int32_t i;
+    for(i = 0; i < 2; ++i) {
+        if(runs[i][1] <= runs[i][0])
+            continue;
+        uint64_t base = console->base[(console->epoch + 1 + i) & 1];
+        
+        GLSFdraw draw;
+        draw.texture = &font->texture;
+        draw.instances = console->instances + runs[i][0];
+        draw.num_instances = runs[i][1] - runs[i][0];
+        draw.offset[0] = rect[0];
+        draw.offset[1] = rect[1] + rect[3] - (float)((double)(console->rows - base) * console->height);
+        if(font->backend.draw)
+            font->backend.draw(font->backend.user, &draw);
+        GLSF_STAT_ADD(&console->batch, draw_calls, 1);
+    }
+    glsfFlushStats(font, &console->batch);
+}
+
+/**
+ * @fn glsfInitEditor
+ * @brief Starts an empty editor for font wrapping lines at width.
+ */
+static void glsfInitEditor( GLSFeditor* editor, GLSFfont* font, float width,
+                            const float color[4] )
+{
+    memset(editor, 0, sizeof(GLSFeditor));
+    editor->font = font;
+    editor->width = width;
+    memcpy(editor->color, color, sizeof(editor->color));
+    editor->batch.font = font;
+}
+
+/**
+ * @fn glsfFreeEditor
+ */
+static void glsfFreeEditor( GLSFeditor* editor )
+{
+    GLSFallocator allocator = editor->allocator;
+    glsfFree(&allocator, editor->text);
+    glsfFree(&allocator, editor->lines);
+    glsfFree(&allocator, editor->instances);
+    glsfFree(&allocator, editor->edits);
+    glsfFreeBatch(&editor->batch);
+    memset(editor, 0, sizeof(GLSFeditor));
+    editor->allocator = allocator;
+}
+
+/**
+ * @fn glsfMoveEditorGap
+ * @brief Moves the gap to the start of a line, carrying the instances of
+ *        the lines it passes to its other side.
+ */
+static void glsfMoveEditorGap( GLSFeditor* editor, size_t line )
+{
+    while(editor->gap_line > line) {
+        GLSFeditline* prev = &editor->lines[--editor->gap_line];
+        editor->gap -= prev->count;
+        editor->gap_end -= prev->count;
+        editor->gap_byte -= prev->length;
+        
+        GLSFinstance* instance = editor->instances + editor->gap_end;
+        memmove(instance, editor->instances + editor->gap, sizeof(GLSFinstance) * prev->count);
+        size_t i;
+        for(i = 0; i < prev->count; ++i)
+            instance[i].y -= editor->shift;
+    }
+    
+    while(editor->gap_line < line) {
+        GLSFeditline* next = &editor->lines[editor->gap_line++];
+        GLSFinstance* instance = editor->instances + editor->gap;
+        memmove(instance, editor->instances + editor->gap_end, sizeof(GLSFinstance) * next->count);
+        size_t i;
+        for(i = 0; i < next->count; ++i)
+            instance[i].y += editor->shift;
+        
+        editor->gap += next->count;
+        editor->gap_end += next->count;
+        editor->gap_byte += next->length;
+    }
+}
+
+/**
+ * @fn glsfLayoutEditor
+ * @brief Lays out every line of an editor again at the font's line height,
+ *        the gap is left after the last.
+ */
+static int32_t glsfLayoutEditor( GLSFeditor* editor )
+{
+    GLSFfont* font = editor->font;
+    GLSFbatch* batch = &editor->batch;
+    
+    // Again while laying out loads taller glyphs.
+    float height;
+    while((height = (float)glsfLoadCount(&font->cache->height)) != editor->height) {
+        float rect[4] = { 0, 0, editor->width, height };
+        size_t start = 0, i;
+        batch->num_instances = 0;
+        for(i = 0; i < editor->num_lines; ++i) {
+            size_t first = batch->num_instances;
+            rect[1] = (float)i * height;
+            glsfBatchStringN(batch, rect, editor->color, editor->text + start, 
+                             editor->lines[i].length);
+            editor->lines[i].count = batch->num_instances - first;
+            start += editor->lines[i].length;
+        }
+        editor->height = height;
+    }
+    
+    size_t count = batch->num_instances;
+    if(glsfGrowArray(&editor->allocator, (void**)&editor->instances, &editor->max_instances, 
+                     count, sizeof(GLSFinstance)) == GL_FALSE) {
+        editor->height = 0;
+        return GL_FALSE;
+    }
+    memcpy(editor->instances, batch->instances, sizeof(GLSFinstance) * count);
+    editor->gap = count;
+    editor->gap_end = editor->max_instances;
+    editor->gap_line = editor->num_lines;
+    editor->gap_byte = editor->length;
+    editor->shift = 0;
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfEditText
+ * @brief Replaces remove bytes at pos with length bytes of text and lays
+ *        out the lines it changes, all of them when a glyph taller than
+ *        any before loaded. Set the text by editing an empty one.
+ */
+static int32_t glsfEditText( GLSFeditor* editor, size_t pos, size_t remove, 
+                             const char* text, size_t length )
+{
+    GLSFfont* font = editor->font;
+    GLSFbatch* batch = &editor->batch;
+    
+    if(pos > editor->length)
+        pos = editor->length;
+    if(remove > editor->length - pos)
+        remove = editor->length - pos;
+    
+    // Every text has a line, maybe empty.
+    if(editor->num_lines == 0) {
+        if(glsfGrowArray(&editor->allocator, (void**)&editor->lines, 
+                         &editor->max_lines, 1, sizeof(GLSFeditline)) == GL_FALSE)
+            return GL_FALSE;
+        editor->lines[0].length = editor->length;
+        editor->lines[0].count = 0;
+        editor->num_lines = 1;
+    }
+    
+    if(glsfGrowArray(&editor->allocator, (void**)&editor->text, &editor->max_length,
+                     editor->length - remove + length, 1) == GL_FALSE)
+        return GL_FALSE;
+    memmove(editor->text + pos + length, editor->text + pos + remove, 
+            editor->length - pos - remove);
+    memcpy(editor->text + pos, text, length);
+    editor->length = editor->length - remove + length;
+    
+    // Find the edited line. A wrapped line before it may take in what
+    // now starts it, lay out from there.
+    size_t line = editor->gap_line, start = editor->gap_byte;
+    while(line > 0 && start > pos) 
+        start -= editor->lines[--line].length;
+    while(line + 1 < editor->num_lines && start + editor->lines[line].length <= pos)
+        start += editor->lines[line++].length;
+    if(line > 0 && editor->text[start - 1] != '\n')
+        start -= editor->lines[--line].length;
+    glsfMoveEditorGap(editor, line);
+    
+    // New breaks until one falls where an old line after the edit starts
+    // again, the rest is laid out the same.
+    GLSFeditline* edits;
+    size_t old = line, old_start = start, num_edits = 0;
+    for(;;) {
+        size_t next = glsfMeasureLine(font, editor->text + start, editor->length - start, 
+                                      editor->width);
+        if(glsfGrowArray(&editor->allocator, (void**)&editor->edits, &editor->max_edits, 
+                         num_edits + 1, sizeof(GLSFeditline)) == GL_FALSE)
+            return GL_FALSE;
+        editor->edits[num_edits++].length = next ? next : editor->length - start;
+        if(next == 0) {
+            old = editor->num_lines;
+            break;
+        }
+        start += next;
+        
+        while(old < editor->num_lines && 
+              (old_start < pos + remove || old_start - remove + length < start))
+            old_start += editor->lines[old++].length;
+        if(old < editor->num_lines && old > line && old_start >= pos + remove &&
+           old_start - remove + length == start)
+            break;
+    }
+    
+    // Drop the old lines' instances behind the gap and lay out the new.
+    size_t i;
+    for(i = line; i < old; ++i)
+        editor->gap_end += editor->lines[i].count;
+    
+    // Measuring loaded the glyphs of the new lines.
+    float height = (float)glsfLoadCount(&font->cache->height);
+    if(editor->height <= 0)
+        editor->height = height;
+    float rect[4] = { 0, 0, editor->width, height };
+    edits = editor->edits;
+    batch->num_instances = 0;
+    start = editor->gap_byte;
+    for(i = 0; i < num_edits; ++i) {
+        size_t first = batch->num_instances;
+        rect[1] = (float)(line + i) * height;
+        glsfBatchStringN(batch, rect, editor->color, editor->text + start, edits[i].length);
+        edits[i].count = batch->num_instances - first;
+        start += edits[i].length;
+    }
+    size_t count = batch->num_instances;
+    
+    // Widen the gap to fit them.
+    if(editor->gap_end - editor->gap < count) {
+        size_t tail = editor->max_instances - editor->gap_end;
+        size_t max = editor->max_instances;
+        if(glsfGrowArray(&editor->allocator, (void**)&editor->instances, &max, 
+                         editor->gap + count + tail, sizeof(GLSFinstance)) == GL_FALSE)
+            return GL_FALSE;
+        memmove(editor->instances + max - tail, editor->instances + editor->gap_end, 
+                sizeof(GLSFinstance) * tail);
+        editor->max_instances = max;
+        editor->gap_end = max - tail;
+    }
+    
+    // Lines replaced, those below move by whole lines.
+    size_t replaced = old - line;
+    if(num_edits != replaced) {
+        if(glsfGrowArray(&editor->allocator, (void**)&editor->lines, &editor->max_lines, 
+                         editor->num_lines - replaced + num_edits, sizeof(GLSFeditline)) == GL_FALSE)
+            return GL_FALSE;
+        memmove(editor->lines + line + num_edits, editor->lines + old, 
+                sizeof(GLSFeditline) * (editor->num_lines - old));
+        editor->num_lines = editor->num_lines - replaced + num_edits;
+        editor->shift += ((float)num_edits - (float)replaced) * editor->height;
+    }
+    memcpy(editor->lines + line, edits, sizeof(GLSFeditline) * num_edits);
+    
+    memcpy(editor->instances + editor->gap, batch->instances, sizeof(GLSFinstance) * count);
+    editor->gap += count;
+    editor->gap_line = line + num_edits;
+    editor->gap_byte = start;
+    
+    // A taller glyph moved the baseline of the lines kept.
+    if(editor->height != (float)glsfLoadCount(&font->cache->height))
+        return glsfLayoutEditor(editor);
+    return GL_TRUE;
+}
+
+/**
+ * @fn glsfDrawEditor
+ * @brief Draws an editor's text with its top left at x, y. Must be called
+ *        in the context owning the font's texture.
+ */
+static void glsfDrawEditor( GLSFeditor* editor, float x, float y )
+{
+    GLSFfont* font = editor->font;
+    if(editor->num_lines > 0 && editor->height != (float)glsfLoadCount(&font->cache->height) &&
+       glsfLayoutEditor(editor) == GL_FALSE)
+        return;
+    if(glsfSyncFont(font) == GL_FALSE || font->texture.width == 0)
+        return;
+    
+    // Lines above the gap, then those below moved by shift.
+    size_t runs[2][2] = { { 0, editor->gap }, { editor->gap_end, editor->max_instances } };
+    int32_t i;
+    for(i = 0; i < 2; ++i) {
+        if(runs[i][1] <= runs[i][0])
+            continue;
+        
+        GLSFdraw draw;
+        draw.texture = &font->texture;
+        draw.instances = editor->instances + runs[i][0];
+        draw.num_instances = runs[i][1] - runs[i][0];
+        draw.offset[0] = x;
+        draw.offset[1] = y + (i ? editor->shift : 0);
+        if(font->backend.draw)
+            font->backend.draw(font->backend.user, &draw);
+        GLSF_STAT_ADD(&editor->batch, draw_calls, 1);
+    }
+    glsfFlushStats(font, &editor->batch);
+}
+
+/**
+ * @fn glsfSetBackend
+ * @brief Switch backend. The font's texture is released through the old
+ *        backend and rebuilt through the new one.
+ */
+static void glsfSetBackend( GLSFfont* font, const GLSFbackend* backend )
+{
+    glsfFreeTexture(font, &font->texture);
+    font->backend = *backend;
+    
+    font->num_synced = 0;
+    glsfSyncFont(font);
+}
+
+/**
+ * @fn glsfInstanceQuad
+ */
+static void glsfInstanceQuad( const GLSFdraw* draw, 
+                              const GLSFinstance* instance, GLSFquad* quad )
+{
+    // Computed as glsfExpandInstances does, to the bit.
+    float sx = 1.0f / draw->texture->width;
+    float sy = 1.0f / draw->texture->height;
+    
+    quad->x0 = instance->x + draw->offset[0];
+    quad->y0 = instance->y + draw->offset[1];
+    quad->x1 = quad->x0 + instance->w;
+    quad->y1 = quad->y0 + instance->h;
+    quad->u0 = instance->s * sx;
+    quad->v0 = instance->t * sy;
+    quad->u1 = quad->u0 + instance->w * sx;
+    quad->v1 = quad->v0 + instance->h * sy;
+    memcpy(quad->color, instance->color, 4);
+}
+
+/**
+ * @fn glsfEmitQuads
+ * @brief Hands each instance of a draw to emit as a quad, for backends
+ *        writing vertices of their own straight into their buffers.
+ */
+static void glsfEmitQuads( const GLSFdraw* draw, 
+                           void (*emit)( void*, const GLSFquad* ), void* user )
+{
+    GLSFquad quad;
+    size_t i;
+    for(i = 0; i < draw->num_instances; ++i) {
+        glsfInstanceQuad(draw, &draw->instances[i], &quad);
+        emit(user, &quad);
+    }
+}
+
+/**
+ * @fn glsfExpandInstances
+ * @brief Writes six vertices per instance of a draw, two triangles each
+ *        as the fixed function renderer draws them. With SSE2 a vertex's
+ *        position and texture coordinates are one vector and its color
+ *        another, each corner is two stores.
+ */
+static void glsfExpandInstances( const GLSFdraw* draw, GLSFvertex* vertices )
+{
+    float sx = 1.0f / draw->texture->width;
+    float sy = 1.0f / draw->texture->height;
+    float dx = draw->offset[0];
+    float dy = draw->offset[1];
+    const GLSFinstance* instance = draw->instances;
+    const GLSFinstance* end = instance + draw->num_instances;
+    
+#ifdef GLSF_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set_ps(sy, sx, 1.0f, 1.0f);
+    const __m128 offset = _mm_set_ps(0.0f, 0.0f, dy, dx);
+    const __m128 unorm = _mm_set1_ps(1.0f / 255.0f);
+    const __m128 odd = _mm_castsi128_ps(_mm_set_epi32(-1, 0, -1, 0));
+    float* out = (float*)vertices;
+    for(; instance < end; ++instance, out += 48) {
+        // (x, y) and (s, t, w, h) make the top left corner and the size.
+        __m128 xy = _mm_castsi128_ps(_mm_loadl_epi64((const __m128i*)&instance->x));
+        __m128 stwh = _mm_cvtepi32_ps(_mm_unpacklo_epi16(
+            _mm_loadl_epi64((const __m128i*)&instance->s), zero));
+        __m128 tl = _mm_add_ps(_mm_mul_ps(_mm_movelh_ps(xy, stwh), scale), offset);
+        __m128 br = _mm_add_ps(tl, _mm_mul_ps(_mm_movehl_ps(stwh, stwh), scale));
+        __m128 bl = _mm_or_ps(_mm_and_ps(odd, br), _mm_andnot_ps(odd, tl));
+        __m128 tr = _mm_or_ps(_mm_and_ps(odd, tl), _mm_andnot_ps(odd, br));
+        
+        int32_t packed;
+        memcpy(&packed, instance->color, 4);
+        __m128i rgba = _mm_cvtsi32_si128(packed);
+        rgba = _mm_unpacklo_epi16(_mm_unpacklo_epi8(rgba, zero), zero);
+        __m128 color = _mm_mul_ps(_mm_cvtepi32_ps(rgba), unorm);
+        
+        _mm_storeu_ps(out, bl);
+        _mm_storeu_ps(out + 4, color);
+        _mm_storeu_ps(out + 8, tl);
+        _mm_storeu_ps(out + 12, color);
+        _mm_storeu_ps(out + 16, br);
+        _mm_storeu_ps(out + 20, color);
+        _mm_storeu_ps(out + 24, tl);
+        _mm_storeu_ps(out + 28, color);
+        _mm_storeu_ps(out + 32, tr);
+        _mm_storeu_ps(out + 36, color);
+        _mm_storeu_ps(out + 40, br);
+        _mm_storeu_ps(out + 44, color);
+    }
+#else
+    GLSFvertex* vertex = vertices;
+    for(; instance < end; ++instance, vertex += 6) {
+        GLSFvertex tl, br;
+        tl.x = instance->x + dx;
+        tl.y = instance->y + dy;
+        tl.u = instance->s * sx;
+        tl.v = instance->t * sy;
+        tl.r = instance->color[0] * (1.0f / 255.0f);
+        tl.g = instance->color[1] * (1.0f / 255.0f);
+        tl.b = instance->color[2] * (1.0f / 255.0f);
+        tl.a = instance->color[3] * (1.0f / 255.0f);
+        br = tl;
+        br.x += instance->w;
+        br.y += instance->h;
+        br.u += instance->w * sx;
+        br.v += instance->h * sy;
+        
+        vertex[0] = tl;
+        vertex[0].y = br.y;
+        vertex[0].v = br.v;
+        vertex[1] = tl;
+        vertex[2] = br;
+        vertex[3] = tl;
+        vertex[4] = br;
+        vertex[4].y = tl.y;
+        vertex[4].v = tl.v;
+        vertex[5] = br;
+    }
+#endif
+}
+
+/**
+ * @fn glsfInitRecorder
+ * @brief Initialize a recorder, see GLSF_RECORD_UPLOADS for flags.
+ */
+static void glsfInitRecorder( GLSFrecorder* recorder, uint32_t flags )
+{
+    memset(recorder, 0, sizeof(GLSFrecorder));
+    recorder->flags = flags;
+}
 
 /**
- * @fn glsfLoadGlyph
+ * @fn glsfClearRecorder
+ * @brief Drops everything recorded and resets counters, keeps memory.
  */
-static int32_t glsfLoadGlyph( GLSFfont* font, uint32_t codepoint, 
-                              GLSFglyph* glyph )
+static void glsfClearRecorder( GLSFrecorder* recorder )
 {
-    glyph->index = stbtt_FindGlyphIndex(&font->info, codepoint);
-    if(glyph->index == 0) 
-        return GL_FALSE;
-    
-    glyph->codepoint = codepoint;
-    glyph->scale = stbtt_ScaleForPixelHeight(&font->info, font->size);
-    
-    int32_t lsb;
-    stbtt_GetGlyphHMetrics(&font->info, glyph->index, 
-                           &glyph->advance, &lsb);
-    stbtt_GetGlyphBitmapBox(&font->info, glyph->index, glyph->scale,
-                            glyph->scale, &glyph->x0, &glyph->y0,
-                            &glyph->x1, &glyph->y1);
-    
-    return GL_TRUE;
+    recorder->num_updates = recorder->num_draws = 0;
+    recorder->bytes_uploaded = recorder->instances_drawn = 0;
+    recorder->num_uploads = recorder->num_pixels = 0;
+    recorder->num_submits = recorder->num_instances = 0;
 }
 
 /**
- * @fn glsfLoadBitmap
+ * @fn glsfFreeRecorder
  */
-static int32_t glsfLoadBitmap( GLSFfont* font, GLSFglyph* glyph, 
-                               GLSFbitmap* bitmap )
+static void glsfFreeRecorder( GLSFrecorder* recorder )
 {
-    bitmap->width = glyph->x1 - glyph->x0;
-    bitmap->height = glyph->y1 - glyph->y0;
-    bitmap->data = (uint8_t*)malloc(sizeof(uint8_t) * 
-                      (bitmap->width * bitmap->height));
-    if(!bitmap->data) 
-        return GL_FALSE;
-    
-    stbtt_MakeGlyphBitmap(&font->info, bitmap->data, bitmap->width, 
-                          bitmap->height, bitmap->width, glyph->scale, 
-                          glyph->scale, glyph->index);
-
-    return GL_TRUE;
+    GLSFallocator allocator = recorder->allocator;
+    glsfFree(&allocator, recorder->uploads);
+    glsfFree(&allocator, recorder->pixels);
+    glsfFree(&allocator, recorder->submits);
+    glsfFree(&allocator, recorder->instances);
+    glsfInitRecorder(recorder, recorder->flags);
+    recorder->allocator = allocator;
 }
 
 /**
- * @fn glsfFreeBitmap
+ * @fn glsfRecordCreateTexture
  */
-static void glsfFreeBitmap( GLSFbitmap* bitmap )
+static int32_t glsfRecordCreateTexture( void* user, GLSFtexture* texture )
 {
-    if(bitmap->data)
-        free(bitmap->data);
-    memset(bitmap, 0, sizeof(GLSFbitmap));
+    GLSFrecorder* recorder = (GLSFrecorder*)user;
+    texture->name = ++recorder->last_name;
+    recorder->num_textures++;
+    return GL_TRUE;
 }
 
 /**
- * @fn glsfLoadTexture
+ * @fn glsfRecordUpdateTexture
  */
-static int32_t glsfLoadTexture( GLSFfont* font, GLSFglyph* glyphs, 
-                                size_t num_glyphs, GLSFtexture* texture )
+static void glsfRecordUpdateTexture( void* user, GLSFtexture* texture, 
+                                     int32_t x, int32_t y, int32_t width, 
+                                     int32_t height, int32_t stride,
+                                     const uint8_t* data )
 {
-    // Find out required dimensions for texture.
-    int32_t req_width = 0, req_height = 0;
-    uint32_t i;
-    for(i = 0; i < num_glyphs; ++i) {
-        int32_t width = glyphs[i].x1 - glyphs[i].x0;
-        int32_t height = glyphs[i].y1 - glyphs[i].y0;
-        req_width += width;
-        if(height > req_height)
-            req_height = height;
-    }
-    
-    if(req_width < 2 || req_height < 2) {
-        fprintf(stderr, "Invalid texture size: %ix%i\n", req_width, req_height);
-        return GL_FALSE;
-    }
-    
-    texture->width = req_width;
-    texture->height = req_height;
-    
-    // Create a blank texture.
-    glGenTextures(1, &texture->name);
-    glBindTexture(GL_TEXTURE_2D, texture->name);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texture->width, texture->height, 
-                 0, GL_ALPHA, GL_UNSIGNED_BYTE, 0);
+    GLSFrecorder* recorder = (GLSFrecorder*)user;
+    size_t size = (size_t)width * height;
+    recorder->num_updates++;
+    recorder->bytes_uploaded += size;
     
-    // Load glyph bitmaps in offsets.
-    int32_t x_offset = 0;
-    for(i = 0; i < num_glyphs; ++i) {
-        GLSFbitmap bitmap;
-        if(glsfLoadBitmap(font, &glyphs[i], &bitmap) == GL_FALSE)
-            continue;
-        
-        glTexSubImage2D(GL_TEXTURE_2D, 0, x_offset, 0, bitmap.width,
-                        bitmap.height, GL_ALPHA, GL_UNSIGNED_BYTE, bitmap.data);
-        
-        glyphs[i].offset = x_offset;
-        x_offset += bitmap.width;
-        
-        glsfFreeBitmap(&bitmap);
-    }
+    if(!(recorder->flags & GLSF_RECORD_UPLOADS))
+        return;
+    if(glsfGrowArray(&recorder->allocator, (void**)&recorder->uploads, &recorder->max_uploads,
+                     recorder->num_uploads + 1, sizeof(GLSFupload)) == GL_FALSE ||
+       glsfGrowArray(&recorder->allocator, (void**)&recorder->pixels, &recorder->max_pixels,
+                     recorder->num_pixels + size, 1) == GL_FALSE)
+        return;
     
-    glBindTexture(GL_TEXTURE_2D, 0);
+    GLSFupload* upload = &recorder->uploads[recorder->num_uploads++];
+    upload->texture = texture->name;
+    upload->x = x;
+    upload->y = y;
+    upload->width = width;
+    upload->height = height;
+    upload->offset = recorder->num_pixels;
     
-    return GL_TRUE;
+    // Store rows tightly packed.
+    int32_t row;
+    for(row = 0; row < height; ++row)
+        memcpy(recorder->pixels + recorder->num_pixels + (size_t)row * width,
+               data + (size_t)row * stride, width);
+    recorder->num_pixels += size;
 }
 
 /**
- * @fn glsfFreeTexture
+ * @fn glsfRecordFreeTexture
  */
-static void glsfFreeTexture( GLSFtexture* texture )
+static void glsfRecordFreeTexture( void* user, GLSFtexture* texture )
 {
+    GLSFrecorder* recorder = (GLSFrecorder*)user;
     if(texture->name)
-        glDeleteTextures(1, &texture->name);
-    memset(texture, 0, sizeof(GLSFtexture));
+        recorder->num_textures--;
 }
 
 /**
- * @fn glsfUpdateFont
+ * @fn glsfRecordDraw
  */
-static int32_t glsfUpdateFont( GLSFfont* font, GLSFglyph* glyphs, 
-                               size_t num_glyphs )
+static void glsfRecordDraw( void* user, const GLSFdraw* draw )
 {
-    if(num_glyphs == 0)
-        return GL_FALSE;
+    GLSFrecorder* recorder = (GLSFrecorder*)user;
+    recorder->num_draws++;
+    recorder->instances_drawn += draw->num_instances;
     
-    // Allocate new memory for concatenated glyphs.
-    size_t num_new_glyphs = font->num_glyphs + num_glyphs;
-    GLSFglyph* new_glyphs = (GLSFglyph*)malloc(sizeof(GLSFglyph) * num_new_glyphs);
-    if(new_glyphs == NULL) 
-        return GL_FALSE;
+    if(!(recorder->flags & GLSF_RECORD_DRAWS))
+        return;
+    if(glsfGrowArray(&recorder->allocator, (void**)&recorder->submits, &recorder->max_submits,
+                     recorder->num_submits + 1, sizeof(GLSFsubmit)) == GL_FALSE ||
+       glsfGrowArray(&recorder->allocator, (void**)&recorder->instances, &recorder->max_instances,
+                     recorder->num_instances + draw->num_instances,
+                     sizeof(GLSFinstance)) == GL_FALSE)
+        return;
     
-    // Copy old glyphs.
-    if(font->num_glyphs > 0)
-        memcpy(new_glyphs, font->glyphs, sizeof(GLSFglyph) * font->num_glyphs);
-    memcpy(new_glyphs + font->num_glyphs, glyphs, sizeof(GLSFglyph) * num_glyphs);
+    GLSFsubmit* submit = &recorder->submits[recorder->num_submits++];
+    submit->texture = draw->texture->name;
+    submit->width = draw->texture->width;
+    submit->height = draw->texture->height;
+    submit->offset = recorder->num_instances;
+    submit->count = draw->num_instances;
+    submit->translation[0] = draw->offset[0];
+    submit->translation[1] = draw->offset[1];
     
-    // Attempt creating a new texture.
-    GLSFtexture new_texture;
-    if(glsfLoadTexture(font, new_glyphs, num_new_glyphs, &new_texture) == GL_FALSE) {
-        free(new_glyphs);
-        return GL_FALSE;
+    memcpy(recorder->instances + recorder->num_instances, draw->instances,
+           sizeof(GLSFinstance) * draw->num_instances);
+    recorder->num_instances += draw->num_instances;
+}
+
+/**
+ * @fn glsfRecorderBackend
+ * @brief A backend recording into memory instead of calling GL.
+ */
+static GLSFbackend glsfRecorderBackend( GLSFrecorder* recorder )
+{
+    GLSFbackend backend;
+    backend.user = recorder;
+    backend.create_texture = glsfRecordCreateTexture;
+    backend.update_texture = glsfRecordUpdateTexture;
+    backend.free_texture = glsfRecordFreeTexture;
+    backend.draw = glsfRecordDraw;
+    return backend;
+}
+
+#ifndef GLSF_NO_GL
+/**
+ * @fn glsfInitState
+ * @brief Initialize a render state, see GLSF_STATE_OWNED for flags.
+ */
+static void glsfInitState( GLSFstate* state, uint32_t flags )
+{
+    memset(state, 0, sizeof(GLSFstate));
+    state->flags = flags;
+}
+
+/**
+ * @fn glsfResetState
+ * @brief Forget everything tracked by the state, a viewport read back
+ *        from GL included, so it is all set again on next draw. Call after
+ *        other code touched the state it owns or resized the viewport.
+ */
+static void glsfResetState( GLSFstate* state )
+{
+    state->valid = GL_FALSE;
+    if(state->read_viewport) {
+        memset(state->viewport, 0, sizeof(state->viewport));
+        state->read_viewport = GL_FALSE;
     }
-    
-    // Replace old glyphs and texture.
-    free(font->glyphs);
-    font->glyphs = new_glyphs;
-    font->num_glyphs = num_new_glyphs;
-    glsfFreeTexture(&font->texture);
-    font->texture = new_texture;
-    
-    return GL_TRUE;
 }
 
 /**
- * @fn glsfGetGlyph
- * @brief Fetch a glyph by codepoint from font. Tries loading the glyph
- *        and adding it if not found.
+ * @fn glsfLoseState
+ * @brief Forget GL objects of a lost context without deleting them, they
+ *        are created again on next draw in the current one.
  */
-static GLSFglyph* glsfGetGlyph( GLSFfont* font, uint32_t codepoint )
+static void glsfLoseState( GLSFstate* state )
 {
-    // Fetch existing glyph in font.
-    uint32_t i;
-    for(i = 0; i < font->num_glyphs; ++i)
-        if(font->glyphs[i].codepoint == codepoint)
-            return &font->glyphs[i];
-    
-    // Load the missing glyph.
-    GLSFglyph new_glyph;
-    if(glsfLoadGlyph(font, codepoint, &new_glyph) == GL_FALSE)
-        return NULL;
-    
-    // Attempt updating font with new glyph.
-    if(glsfUpdateFont(font, &new_glyph, 1) == GL_FALSE)
-        return NULL;
-    
-    // Success.
-    return glsfGetGlyph(font, codepoint);
-    //return &font->glyphs[font->num_glyphs - 1];
+#ifdef GLSF_SHADER
+    state->program = state->vao = state->vbo = 0;
+    state->vbo_size = 0;
+#endif
+    state->texture = 0;
+    state->pointer = NULL;
+    state->max_texture_size = 0;
+    glsfResetState(state);
 }
 
 /**
- * @fn glsfCreateFont
+ * @fn glsfSetViewport
+ * @brief Tell the state the viewport being drawn to, which saves reading
+ *        it back from GL. Call again whenever it changes.
  */
-static GLSFfont* glsfCreateFont( const char* filename, float size,
-                                 const char* pre )
+static void glsfSetViewport( GLSFstate* state, int32_t x, int32_t y,
+                             int32_t width, int32_t height )
 {
-    // Read file.
-    FILE* file = fopen(filename, "rb");
-    if(!file) {
-        fprintf(stderr, "Failed opening \"%s\".\n", filename);
-        return NULL;
+    state->viewport[0] = x;
+    state->viewport[1] = y;
+    state->viewport[2] = width;
+    state->viewport[3] = height;
+    state->read_viewport = GL_FALSE;
+}
+
+/**
+ * @fn glsfSetState
+ * @brief Share a render state between fonts drawing in the same context.
+ *        Passing NULL restores the font's own state. Selects the GL
+ *        backend but keeps the texture, see glsfSetBackend.
+ */
+static void glsfSetState( GLSFfont* font, GLSFstate* state )
+{
+    font->backend = glsfGLBackend(state ? state : &font->default_state);
+}
+
+/**
+ * @fn glsfBuildVertices
+ * @brief Expands the font's instances into six vertices each for the
+ *        fixed function renderer.
+ */
+static size_t glsfBuildVertices( GLSFstate* state, const GLSFdraw* draw )
+{
+    // Resize vertex array if needed.
+    size_t num_vertices = draw->num_instances * 6;
+    if(num_vertices > state->max_vertices) {
+        GLSFvertex* vertices = (GLSFvertex*)glsfAlloc(&state->allocator, 
+                                                      sizeof(GLSFvertex)*num_vertices);
+        if(!vertices)
+            return 0;
+        glsfFree(&state->allocator, state->vertices);
+        state->vertices = vertices;
+        state->max_vertices = num_vertices;
     }
     
-    fseek(file, 0, SEEK_END);
-    size_t filesize = ftell(file);
-    fseek(file, 0, SEEK_SET);
-    uint8_t* buffer = (uint8_t*)malloc(filesize);
-    if(!buffer) {
-        fprintf(stderr, "Failed allocating file buffer.\n");
-        fclose(file);
-        return NULL;
+    glsfExpandInstances(draw, state->vertices);
+    return num_vertices;
+}
+
+/**
+ * @fn glsfDrawFixed
+ * @brief Draws the font's instances with client side vertex arrays.
+ */
+static void glsfDrawFixed( GLSFstate* state, const GLSFdraw* draw, 
+                           int32_t width, int32_t height )
+{
+    int32_t owned = state->flags & GLSF_STATE_OWNED;
+    
+    size_t num_vertices = glsfBuildVertices(state, draw);
+    if(num_vertices == 0)
+        return;
+    
+    // Set required states. Only done once when the caller owns the state.
+    if(!owned || !state->valid) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glEnableClientState(GL_COLOR_ARRAY);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glEnable(GL_TEXTURE_2D);
+        state->valid = GL_TRUE;
+        state->projected[0] = state->projected[1] = 0;
+        state->texture = 0;
+        state->pointer = NULL;
     }
-    fread(buffer, 1, filesize, file);
-    fclose(file);
     
-    // Create and initialize font.
-    GLSFfont* new_font = (GLSFfont*)malloc(sizeof(GLSFfont));
-    memset(new_font, 0, sizeof(GLSFfont));
-   
-    if(!stbtt_InitFont(&new_font->info, buffer, 0)) {
-        fprintf(stderr, "Failed initializing font.\n");
-        free(buffer);
-        glsfDestroyFont(new_font);
-        return NULL;
+    // Pixel space projection with zero at the top.
+    if(!owned) {
+        glMatrixMode(GL_PROJECTION);
+        glPushMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+    }
+    if(!owned || state->projected[0] != width || 
+       state->projected[1] != height) {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(0, width, height, 0, -1, 1);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        state->projected[0] = width;
+        state->projected[1] = height;
     }
     
-    stbtt_GetFontVMetrics(&new_font->info, &new_font->ascent,
-                          &new_font->descent, &new_font->linegap);
-    new_font->size = size;
-    new_font->data = buffer;
+    if(!owned || state->pointer != state->vertices) {
+        glVertexPointer(2, GL_FLOAT, sizeof(GLSFvertex), state->vertices);
+        glTexCoordPointer(2, GL_FLOAT, sizeof(GLSFvertex), &((float*)state->vertices)[2]);
+        glColorPointer(4, GL_FLOAT, sizeof(GLSFvertex), &((float*)state->vertices)[4]);
+        state->pointer = state->vertices;
+    }
     
-    // Initialize vertex array with some kind of size.
-    new_font->vertices = (GLSFvertex*)malloc(sizeof(GLSFvertex) * 128);
-    new_font->max_vertices = 128;
+    if(!owned || state->texture != draw->texture->name) {
+        glBindTexture(GL_TEXTURE_2D, draw->texture->name);
+        state->texture = draw->texture->name;
+    }
 
-    // Preload some glyphs.
-    if(strlen(pre) > 0) {
-        GLSFglyph* new_glyphs = (GLSFglyph*)malloc(sizeof(GLSFglyph) * strlen(pre));
-        uint32_t num_new_glyphs = 0;
-        uint32_t state, codepoint;
-        uint32_t i, j;
-        for(state = UTF8_ACCEPT, i = 0; i < strlen(pre); ++i) {
-            if(decutf8(&state, &codepoint, (uint8_t)pre[i]))
-                continue;
-            // Skip duplicates.
-            int32_t duplicate = GL_FALSE;
-            for(j = 0; j < i; ++j) {
-                if(codepoint == new_glyphs[j].codepoint) {
-                    duplicate = GL_TRUE;
-                    break;
-                }
-            }
-            if(duplicate == GL_FALSE && 
-               glsfLoadGlyph(new_font, codepoint, &new_glyphs[num_new_glyphs]) == GL_TRUE) {
-                num_new_glyphs++;
-            }
-        }
-        glsfUpdateFont(new_font, new_glyphs, num_new_glyphs);
-        free(new_glyphs);
+    // Draw the vertices.
+    glDrawArrays(GL_TRIANGLES, 0, num_vertices);
+
+    // Restore states.
+    if(!owned) {
+        glMatrixMode(GL_PROJECTION);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state->texture = 0;
     }
-    
-    return new_font;
 }
 
+#ifdef GLSF_SHADER
 /**
- * @fn glsfDestroyFont
+ * Instance expanded into a quad by the vertex shader using gl_VertexID
+ * as corner, pixel to clip space transform and texel size are uniforms.
  */
-static void glsfDestroyFont( GLSFfont* font )
+static const char* _glsf_vertex_shader =
+    "#version 330 core\n"
+    "layout(location = 0) in vec2 a_position;\n"
+    "layout(location = 1) in vec4 a_rect;\n"
+    "layout(location = 2) in vec4 a_color;\n"
+    "uniform vec4 u_transform;\n"
+    "uniform vec2 u_texel;\n"
+    "out vec2 v_texcoord;\n"
+    "out vec4 v_color;\n"
+    "void main() {\n"
+    "    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+    "    vec2 position = a_position + corner * a_rect.zw;\n"
+    "    v_texcoord = (a_rect.xy + corner * a_rect.zw) * u_texel;\n"
+    "    v_color = a_color;\n"
+    "    gl_Position = vec4(position * u_transform.xy + u_transform.zw, 0, 1);\n"
+    "}\n";
+
+static const char* _glsf_fragment_shader =
+    "#version 330 core\n"
+    "uniform sampler2D u_texture;\n"
+    "in vec2 v_texcoord;\n"
+    "in vec4 v_color;\n"
+    "out vec4 f_color;\n"
+    "void main() {\n"
+    "    f_color = vec4(v_color.rgb, v_color.a * texture(u_texture, v_texcoord).a);\n"
+    "}\n";
+
+/**
+ * @fn glsfCompileShader
+ */
+static uint32_t glsfCompileShader( GLenum type, const char* source )
 {
-    glsfFreeTexture(&font->texture);
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
     
-    if(font->data)
-        free(font->data);
-    if(font->glyphs)
-        free(font->glyphs);
-    if(font->vertices)
-        free(font->vertices);
-
-    free(font);
+    GLint status;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if(status == GL_FALSE) {
+        char log[512];
+        glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+        fprintf(stderr, "Failed compiling shader: %s\n", log);
+        glDeleteShader(shader);
+        return 0;
+    }
+    
+    return shader;
 }
 
 /**
- * @fn glsfEnqueueGlyph
- * @brief Adds vertices for a glyph in font's vertex array.
+ * @fn glsfLoadProgram
+ * @brief Creates the program and buffers of a state, needs to be done in
+ *        its context so it is done on first draw.
  */
-static void glsfEnqueueGlyph( GLSFfont* font, GLSFglyph* glyph, float x, 
-                              float y, const float color[4] )
+static int32_t glsfLoadProgram( GLSFstate* state )
 {
-    if(font->num_vertices + 6 > font->max_vertices)
-        return;
-
-    // Get viewport.
-    int32_t viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
-
-    // Glyph dimensions in pixels. 
-    float gw = glyph->x1 - glyph->x0;
-    float gh = glyph->y1 - glyph->y0;
-    
-    // Texture dimensions. 
-    float tw = font->texture.width;
-    float th = font->texture.height;
-    
-    // Quad coords in pixels. 
-    float x0 = x;
-    float y0 = -y - glyph->y1; // glyph->y1 for vertical offset in bbox 
-    float x1 = x0 + gw;
-    float y1 = y0 + gh;
-    
-    // Texcoords. 
-    float u0 = (float)glyph->offset / tw;
-    float v0 = gh / th;
-    float u1 = u0 + (gw / tw);
-    float v1 = 0;
-    
-    // Offset Y with viewport height so zero is top. 
-    y0 = y0 + viewport[3] - th;
-    y1 = y1 + viewport[3] - th;
-    
-    // Transform quad coords into screen space. 
-    x0 = (x0 / viewport[2]) * 2 - 1;
-    y0 = (y0 / viewport[3]) * 2 - 1;
-    x1 = (x1 / viewport[2]) * 2 - 1;
-    y1 = (y1 / viewport[3]) * 2 - 1;
-    
-    // Add to vertex array.
-    #define GLSF_VERTEX( X, Y, U, V ) \
-        font->vertices[font->num_vertices].x = X;\
-        font->vertices[font->num_vertices].y = Y;\
-        font->vertices[font->num_vertices].u = U;\
-        font->vertices[font->num_vertices].v = V;\
-        font->vertices[font->num_vertices].r = color[0];\
-        font->vertices[font->num_vertices].g = color[1];\
-        font->vertices[font->num_vertices].b = color[2];\
-        font->vertices[font->num_vertices].a = color[3];\
-        font->num_vertices++;
-    
-    GLSF_VERTEX(x0, y0, u0, v0);
-    GLSF_VERTEX(x0, y1, u0, v1);
-    GLSF_VERTEX(x1, y0, u1, v0);
-    GLSF_VERTEX(x0, y1, u0, v1);
-    GLSF_VERTEX(x1, y1, u1, v1);
-    GLSF_VERTEX(x1, y0, u1, v0);
-    
-    #undef GLSF_VERTEX
+    GLuint vs = glsfCompileShader(GL_VERTEX_SHADER, _glsf_vertex_shader);
+    GLuint fs = glsfCompileShader(GL_FRAGMENT_SHADER, _glsf_fragment_shader);
+    if(!vs || !fs) {
+        if(vs) glDeleteShader(vs);
+        if(fs) glDeleteShader(fs);
+        return GL_FALSE;
+    }
+    
+    GLuint program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    
+    GLint status;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if(status == GL_FALSE) {
+        char log[512];
+        glGetProgramInfoLog(program, sizeof(log), NULL, log);
+        fprintf(stderr, "Failed linking program: %s\n", log);
+        glDeleteProgram(program);
+        return GL_FALSE;
+    }
+    
+    state->program = program;
+    state->u_transform = glGetUniformLocation(program, "u_transform");
+    state->u_texel = glGetUniformLocation(program, "u_texel");
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "u_texture"), 0);
+    glUseProgram(0);
+    
+    // Instance attributes.
+    glGenVertexArrays(1, &state->vao);
+    glGenBuffers(1, &state->vbo);
+    glBindVertexArray(state->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLSFinstance), 
+                          (const void*)offsetof(GLSFinstance, x));
+    glVertexAttribPointer(1, 4, GL_UNSIGNED_SHORT, GL_FALSE, sizeof(GLSFinstance), 
+                          (const void*)offsetof(GLSFinstance, s));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GLSFinstance), 
+                          (const void*)offsetof(GLSFinstance, color));
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    
+    return GL_TRUE;
 }
 
 /**
- * @fn glsfEnqueueString
- * @brief Prepare a string to be drawn for font by calling EnqueueGlyph
- *        for each character.
+ * @fn glsfDrawShader
+ * @brief Draws the font's instances with one instanced draw call.
  */
-static void glsfEnqueueString( GLSFfont* font, const float rect[4],
-                               const float color[4], const char* string )
+static void glsfDrawShader( GLSFstate* state, const GLSFdraw* draw, 
+                            int32_t width, int32_t height )
 {
-    // Count number of glyphs in UTF-8 string.
-    uint32_t i, num_glyphs = 0;
-    uint32_t state, codepoint;
-    for(state = UTF8_ACCEPT, i = 0; i < strlen(string); ++i) {
-        if(decutf8(&state, &codepoint, (uint8_t)string[i]))
-            continue;
-        num_glyphs++;
+    int32_t owned = state->flags & GLSF_STATE_OWNED;
+    
+    if(!state->program && glsfLoadProgram(state) == GL_FALSE)
+        return;
+    
+    // Set required states. Only done once when the caller owns the state.
+    if(!owned || !state->valid) {
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glActiveTexture(GL_TEXTURE0);
+        glUseProgram(state->program);
+        glBindVertexArray(state->vao);
+        glBindBuffer(GL_ARRAY_BUFFER, state->vbo);
+        state->valid = GL_TRUE;
+        state->projected[0] = state->projected[1] = 0;
+        state->texture = 0;
     }
     
-    // Number of vertices needed for this string.
-    size_t num_vertices = num_glyphs * 6;
+    // Pixel space to clip space with zero at the top, moved by offset.
+    if(!owned || state->projected[0] != width || 
+       state->projected[1] != height ||
+       state->translated[0] != draw->offset[0] ||
+       state->translated[1] != draw->offset[1]) {
+        float sx = 2.0f / width, sy = -2.0f / height;
+        glUniform4f(state->u_transform, sx, sy, draw->offset[0] * sx - 1,
+                    draw->offset[1] * sy + 1);
+        state->projected[0] = width;
+        state->projected[1] = height;
+        state->translated[0] = draw->offset[0];
+        state->translated[1] = draw->offset[1];
+    }
     
-    // Resize vertex array if needed.
-    if(num_vertices > font->max_vertices - font->num_vertices) {
-        size_t max_vertices = font->num_vertices + num_vertices;
-        GLSFvertex* vertices = (GLSFvertex*)malloc(sizeof(GLSFvertex)*max_vertices);
-        memcpy(vertices, font->vertices, sizeof(GLSFvertex)*font->num_vertices);
-        free(font->vertices);
-        font->vertices = vertices;
-        font->max_vertices = max_vertices;
+    if(!owned || state->texture != draw->texture->name) {
+        glBindTexture(GL_TEXTURE_2D, draw->texture->name);
+        state->texture = draw->texture->name;
     }
+    // Texture size changes whenever glyphs are added, so always set.
+    glUniform2f(state->u_texel, 1.0f / draw->texture->width, 
+                1.0f / draw->texture->height);
     
-    // Vertical advance.
-    float adv_y = (float)font->texture.height;
+    // Stream instances, orphaning the previous contents.
+    size_t size = sizeof(GLSFinstance) * draw->num_instances;
+    if(size > state->vbo_size) {
+        glBufferData(GL_ARRAY_BUFFER, size, draw->instances, GL_STREAM_DRAW);
+        state->vbo_size = size;
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, state->vbo_size, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, size, draw->instances);
+    }
     
-    // Add glyphs to vertex array.
-    float cur_x = 0, cur_y = 0;
-    for(state = UTF8_ACCEPT, i = 0; i < strlen(string); ++i) {
-        if(decutf8(&state, &codepoint, *((uint8_t*)&string[i])))
-            continue;
-        
-        // Handle newlines.
-        if(codepoint == '\n') {
-            cur_x = 0;
-            cur_y += adv_y;
-            continue;
-        }
-        
-        GLSFglyph* glyph = glsfGetGlyph(font, codepoint);
-        if(!glyph)
-            continue;
-        
-        // Ignore space after newline.
-        if(cur_x == 0 && glyph->codepoint == ' ')
-            continue;
-        
-        // Horizontal Advance.
-        float adv_x = (float)glyph->advance * glyph->scale;
-        
-        // Handle linebreaking.
-        if(cur_x + adv_x > rect[2]) {
-            cur_x = 0;
-            cur_y += adv_y;
-        }
-        
-        glsfEnqueueGlyph(font, glyph, cur_x + rect[0], cur_y + rect[1], color);
-        
-        // Advance cursor.
-        cur_x += adv_x;
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, draw->num_instances);
+    
+    // Restore states.
+    if(!owned) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+        glUseProgram(0);
+        state->texture = 0;
     }
 }
+#endif
 
 /**
- * @fn glsfDrawFont
- * @brief Draws a font's vertices after some calls to EnqueueString.
+ * @fn glsfFreeState
+ * @brief Releases GL objects owned by a state, its context must be current.
  */
-static void glsfDrawFont( GLSFfont* font )
+static void glsfFreeState( GLSFstate* state )
 {
-    // Enough vertices for anything to be drawn?
-    if(font->num_vertices < 6)
-        return;
+#ifdef GLSF_SHADER
+    if(state->vbo)
+        glDeleteBuffers(1, &state->vbo);
+    if(state->vao)
+        glDeleteVertexArrays(1, &state->vao);
+    if(state->program)
+        glDeleteProgram(state->program);
+#endif
+    GLSFallocator allocator = state->allocator;
+    glsfFree(&allocator, state->vertices);
+    glsfInitState(state, state->flags);
+    state->allocator = allocator;
+}
 
-    // Backup some states.
-    float modelview[16];
-    float projection[16];
-    glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
-    glGetFloatv(GL_PROJECTION_MATRIX, projection);
-    
-    // Set required states.
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glMatrixMode(GL_MODELVIEW);
-    glLoadIdentity();
-    glEnableClientState(GL_VERTEX_ARRAY);
-    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-    glEnableClientState(GL_COLOR_ARRAY);
-    glVertexPointer(2, GL_FLOAT, sizeof(GLSFvertex), font->vertices);
-    glTexCoordPointer(2, GL_FLOAT, sizeof(GLSFvertex), &((float*)font->vertices)[2]);
-    glColorPointer(4, GL_FLOAT, sizeof(GLSFvertex), &((float*)font->vertices)[4]);
-    
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glEnable(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, font->texture.name);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+/**
+ * @fn glsfGLCreateTexture
+ */
+static int32_t glsfGLCreateTexture( void* user, GLSFtexture* texture )
+{
+    GLSFstate* state = (GLSFstate*)user;
+    
+    // Define GLSF_MAX_ATLAS_HEIGHT lower where the atlas outgrows this.
+    // The limit is read back once per context, not on every texture.
+    if(state->max_texture_size == 0) {
+        GLint max_size = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+        state->max_texture_size = (int32_t)max_size;
+    }
+    if(texture->width > state->max_texture_size || 
+       texture->height > state->max_texture_size) {
+        fprintf(stderr, "Texture size %ix%i over GL_MAX_TEXTURE_SIZE %i.\n", 
+                texture->width, texture->height, state->max_texture_size);
+        return GL_FALSE;
+    }
+    
+    // Sampling parameters are set once here so drawing never has to.
+    glGenTextures(1, &texture->name);
+    glBindTexture(GL_TEXTURE_2D, texture->name);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    // Draw the vertices.
-    glDrawArrays(GL_TRIANGLES, 0, font->num_vertices);
-
-    // Restore states.
-    glMatrixMode(GL_MODELVIEW);
-    glLoadMatrixf(modelview);
-    glMatrixMode(GL_PROJECTION);
-    glLoadMatrixf(projection);
+#ifdef GLSF_SHADER
+    // GL_ALPHA is gone from core profiles, a swizzled GL_R8 samples the
+    // same in both renderers.
+    GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, texture->width, texture->height, 
+                 0, GL_RED, GL_UNSIGNED_BYTE, 0);
+#else
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texture->width, texture->height, 
+                 0, GL_ALPHA, GL_UNSIGNED_BYTE, 0);
+#endif
+    state->texture = texture->name;
     
-    glBindTexture(GL_TEXTURE_2D, 0);
+    if(!(state->flags & GLSF_STATE_OWNED)) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state->texture = 0;
+    }
     
-    // Mark vertices drawn.
-    font->num_vertices = 0;
+    return GL_TRUE;
 }
 
 /**
- * @fn glsfDrawString
+ * @fn glsfGLUpdateTexture
  */
-static void glsfDrawString( GLSFfont* font, const float rect[4], 
-                            const float color[4], const char* string )
+static void glsfGLUpdateTexture( void* user, GLSFtexture* texture, 
+                                 int32_t x, int32_t y, int32_t width, 
+                                 int32_t height, int32_t stride,
+                                 const uint8_t* data )
 {
-    glsfEnqueueString(font, rect, color, string);
-    glsfDrawFont(font);
+    GLSFstate* state = (GLSFstate*)user;
+    
+    if(state->texture != texture->name) {
+        glBindTexture(GL_TEXTURE_2D, texture->name);
+        state->texture = texture->name;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, stride);
+#ifdef GLSF_SHADER
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, 
+                    GL_RED, GL_UNSIGNED_BYTE, data);
+#else
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, 
+                    GL_ALPHA, GL_UNSIGNED_BYTE, data);
+#endif
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    
+    if(!(state->flags & GLSF_STATE_OWNED)) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+        state->texture = 0;
+    }
 }
 
 /**
- * @fn glsfBegin
+ * @fn glsfGLFreeTexture
  */
-static void glsfBegin( GLSFfont* font )
+static void glsfGLFreeTexture( void* user, GLSFtexture* texture )
 {
-    _glsf_font = font;
+    GLSFstate* state = (GLSFstate*)user;
+    
+    if(texture->name) {
+        glDeleteTextures(1, &texture->name); // Unbinds it if bound.
+        if(state->texture == texture->name)
+            state->texture = 0;
+    }
 }
 
 /**
- * @fn glsfEnd
+ * @fn glsfGLDraw
  */
-static void glsfEnd()
+static void glsfGLDraw( void* user, const GLSFdraw* draw )
 {
-    glsfDrawFont(_glsf_font);
-    _glsf_font = NULL;
+    GLSFstate* state = (GLSFstate*)user;
+    
+    // Viewport size, only read back once if the caller never told us,
+    // see glsfResetState.
+    if(state->viewport[2] == 0 || state->viewport[3] == 0) {
+        if(state->flags & GLSF_STATE_OWNED)
+            return;
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        state->viewport[0] = viewport[0];
+        state->viewport[1] = viewport[1];
+        state->viewport[2] = viewport[2];
+        state->viewport[3] = viewport[3];
+        state->read_viewport = GL_TRUE;
+    }
+    int32_t width = state->viewport[2], height = state->viewport[3];
+    
+#ifdef GLSF_SHADER
+    if(state->flags & GLSF_STATE_SHADER)
+        glsfDrawShader(state, draw, width, height);
+    else
+#endif
+        glsfDrawFixed(state, draw, width, height);
 }
 
 /**
- * @fn glsfString
+ * @fn glsfGLBackend
+ * @brief The GL renderers as a backend drawing with the given state.
  */
-static void glsfString( const float rect[4], const float color[4],
-                        const char* string )
+static GLSFbackend glsfGLBackend( GLSFstate* state )
 {
-    glsfEnqueueString(_glsf_font, rect, color, string);
+    GLSFbackend backend;
+    backend.user = state;
+    backend.create_texture = glsfGLCreateTexture;
+    backend.update_texture = glsfGLUpdateTexture;
+    backend.free_texture = glsfGLFreeTexture;
+    backend.draw = glsfGLDraw;
+    return backend;
 }
 
 #endif
+
+#endif
@@ -2,8 +2,14 @@
 #define __GLSF_HPP__
 
 #include "glsf.h"
+#include <cstring>
 #include <stdexcept>
+#include <string>
+#include <utility>
 #include <vector>
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
 
 namespace glsf {
 
@@ -50,8 +56,213 @@ struct String
     std::string string;
 };
 
+/**
+ * @struct Text
+ * @brief A string to draw that points into the caller's memory instead
+ *        of owning a copy. It must stay alive until drawn.
+ */
+struct Text
+{
+    Text()
+      : data(NULL), size(0) {}
+    
+    Text( const Rect& rect__, const Color& color__, const char* data__, size_t size__ )
+      : rect(rect__), color(color__), data(data__), size(size__) {}
+    
+    Text( const Rect& rect__, const Color& color__, const char* string__ )
+      : rect(rect__), color(color__), data(string__), size(std::strlen(string__)) {}
+    
+    Text( const Rect& rect__, const Color& color__, const std::string& string__ )
+      : rect(rect__), color(color__), data(string__.data()), size(string__.size()) {}
+    
+#if __cplusplus >= 201703L
+    Text( const Rect& rect__, const Color& color__, std::string_view string__ )
+      : rect(rect__), color(color__), data(string__.data()), size(string__.size()) {}
+#endif
+    
+    Rect rect;
+    Color color;
+    const char* data;
+    size_t size;
+};
+
+/**
+ * @class Span
+ * @brief A view of contiguous elements: a pointer and a count, taken from
+ *        an array or vector without copying.
+ */
+template<typename T>
+class Span
+{
+public:
+    Span()
+      : data_(NULL), size_(0) {}
+    
+    Span( const T* data__, size_t size__ )
+      : data_(data__), size_(size__) {}
+    
+    template<size_t N>
+    Span( const T (&array__)[N] )
+      : data_(array__), size_(N) {}
+    
+    Span( const std::vector<T>& vector__ )
+      : data_(vector__.empty() ? NULL : &vector__[0]), size_(vector__.size()) {}
+    
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    const T* begin() const { return data_; }
+    const T* end() const { return data_ + size_; }
+    const T& operator[]( size_t i__ ) const { return data_[i__]; }
+
+private:
+    const T* data_;
+    size_t size_;
+};
+
+/**
+ * How emit() lays out glyph quads: six vertices each as two triangles,
+ * or four each to be drawn with the indices() of as many glyphs.
+ */
+enum Topology { TRIANGLES, INDEXED };
+
+/**
+ * @struct VertexPolicy
+ * @brief An emit() policy writing GLSFvertex triangles. A policy names
+ *        its vertex type and topology and writes one corner of a quad,
+ *        given its position in pixels, normalized texture coordinates
+ *        and 8-bit RGBA color.
+ */
+struct VertexPolicy
+{
+    typedef GLSFvertex Vertex;
+    static const Topology topology = TRIANGLES;
+    
+    static void write( Vertex& vertex__, float x__, float y__, 
+                       float u__, float v__, const uint8_t* color__ )
+    {
+        vertex__.x = x__;
+        vertex__.y = y__;
+        vertex__.u = u__;
+        vertex__.v = v__;
+        vertex__.r = color__[0] * (1.0f / 255.0f);
+        vertex__.g = color__[1] * (1.0f / 255.0f);
+        vertex__.b = color__[2] * (1.0f / 255.0f);
+        vertex__.a = color__[3] * (1.0f / 255.0f);
+    }
+};
+
+/**
+ * Writes the glyphs of a draw as quads straight into vertices__, a
+ * mapped buffer for one, as many as fit in max_vertices__. Call it from
+ * a backend's draw. Returns the number of vertices written.
+ */
+template<typename Policy>
+size_t emit( const GLSFdraw& draw__, typename Policy::Vertex* vertices__, 
+             size_t max_vertices__ )
+{
+    size_t count = max_vertices__ / (Policy::topology == INDEXED ? 4 : 6);
+    if( count > draw__.num_instances )
+        count = draw__.num_instances;
+    
+    typename Policy::Vertex* vertex = vertices__;
+    GLSFquad q;
+    for( size_t i = 0; i < count; ++i ) {
+        glsfInstanceQuad(&draw__, &draw__.instances[i], &q);
+        if( Policy::topology == INDEXED ) {
+            Policy::write(vertex[0], q.x0, q.y0, q.u0, q.v0, q.color);
+            Policy::write(vertex[1], q.x0, q.y1, q.u0, q.v1, q.color);
+            Policy::write(vertex[2], q.x1, q.y0, q.u1, q.v0, q.color);
+            Policy::write(vertex[3], q.x1, q.y1, q.u1, q.v1, q.color);
+            vertex += 4;
+        } else {
+            Policy::write(vertex[0], q.x0, q.y1, q.u0, q.v1, q.color);
+            Policy::write(vertex[1], q.x0, q.y0, q.u0, q.v0, q.color);
+            Policy::write(vertex[2], q.x1, q.y1, q.u1, q.v1, q.color);
+            Policy::write(vertex[3], q.x0, q.y0, q.u0, q.v0, q.color);
+            Policy::write(vertex[4], q.x1, q.y0, q.u1, q.v0, q.color);
+            Policy::write(vertex[5], q.x1, q.y1, q.u1, q.v1, q.color);
+            vertex += 6;
+        }
+    }
+    return vertex - vertices__;
+}
+
+/**
+ * Writes six indices per glyph for quads emitted INDEXED, the first
+ * glyph's vertices starting at first__. The same for every frame, so
+ * usually written once into a static index buffer.
+ */
+template<typename Index>
+void indices( Index* indices__, size_t glyphs__, size_t first__ = 0 )
+{
+    for( size_t i = 0; i < glyphs__; ++i ) {
+        Index base = (Index)(first__ + i * 4);
+        indices__[0] = base + 1;
+        indices__[1] = base + 0;
+        indices__[2] = base + 3;
+        indices__[3] = base + 0;
+        indices__[4] = base + 2;
+        indices__[5] = base + 3;
+        indices__ += 6;
+    }
+}
+
+/**
+ * @class Face
+ * @brief A loaded font file. Copies share it, it is freed with the last
+ *        copy and the last font made from it.
+ */
+class Face
+{
+public:
+    Face()
+      : face_(NULL) {}
+    
+    explicit Face( const char* filename__, const GLSFallocator* allocator__ = NULL )
+      : face_(glsfLoadFace(filename__, allocator__))
+    {
+        if( face_ == NULL )
+            throw std::runtime_error("glsfLoadFace failed");
+    }
+    
+    /**
+     * Takes another reference to face__.
+     */
+    explicit Face( GLSFface* face__ )
+      : face_(face__ ? glsfRetainFace(face__) : NULL) {}
+    
+    Face( const Face& other__ )
+      : face_(other__.face_ ? glsfRetainFace(other__.face_) : NULL) {}
+    
+    Face( Face&& other__ ) noexcept
+      : face_(other__.face_) { other__.face_ = NULL; }
+    
+    ~Face() { reset(); }
+    
+    Face& operator=( Face other__ ) noexcept
+    {
+        std::swap(face_, other__.face_);
+        return *this;
+    }
+    
+    void reset()
+    {
+        if( face_ )
+            glsfReleaseFace(face_);
+        face_ = NULL;
+    }
+    
+    GLSFface* handle() const { return face_; }
+
+private:
+    GLSFface* face_;
+};
+
 /**
  * @class Font
+ * @brief Owns a GLSFfont. Move only, so fonts can be kept in containers
+ *        without copies freeing one another. Sizes made from one Face
+ *        share its file, fonts made with share() its glyphs.
  */
 class Font
 {
@@ -67,14 +278,82 @@ public:
             throw std::runtime_error("glsfCreateFont failed");
     }
     
+    Font( const Face& face__, float size__, const char* pre__ = "" )
+      : font_(NULL), size_(size__)
+    {
+        if( face__.handle() )
+            font_ = glsfCreateFontFace(face__.handle(), size__, pre__);
+        if( font_ == NULL )
+            throw std::runtime_error("glsfCreateFontFace failed");
+    }
+    
+    Font( Font&& other__ ) noexcept
+      : font_(other__.font_), size_(other__.size_) { other__.font_ = NULL; }
+    
+    Font( const Font& ) = delete;
+    Font& operator=( const Font& ) = delete;
+    
+    ~Font() { reset(); }
+    
+    Font& operator=( Font&& other__ ) noexcept
+    {
+        if( this != &other__ ) {
+            reset();
+            font_ = other__.font_;
+            size_ = other__.size_;
+            other__.font_ = NULL;
+        }
+        return *this;
+    }
+    
+    void reset()
+    {
+        if( font_ )
+            glsfDestroyFont(font_);
+        font_ = NULL;
+    }
+    
+    /**
+     * A font sharing this one's glyphs, to draw in another context.
+     */
+    Font share() const
+    {
+        Font shared;
+        shared.font_ = font_ ? glsfCreateFontShared(font_) : NULL;
+        shared.size_ = size_;
+        if( font_ && shared.font_ == NULL )
+            throw std::runtime_error("glsfCreateFontShared failed");
+        return shared;
+    }
+    
+    Face face() const { return Face(font_ ? font_->cache->face : NULL); }
+    
     void draw( const std::vector<String>& strings__ )
     {
         glsfBegin(font_);
-        for( int i = 0; i < strings__.size(); ++i ) {
-            glsfString( 
-                (float*)&strings__[i].rect,
-                (float*)&strings__[i].color,
-                strings__[i].string.c_str() );
+        for( size_t i = 0; i < strings__.size(); ++i ) {
+            glsfStringN( 
+                (const float*)&strings__[i].rect,
+                (const float*)&strings__[i].color,
+                strings__[i].string.data(),
+                strings__[i].string.size() );
+        }
+        glsfEnd();
+    }
+    
+    /**
+     * Draws strings in one batch without copying them, nothing is
+     * allocated once the batch has grown to fit.
+     */
+    void draw( Span<Text> texts__ )
+    {
+        glsfBegin(font_);
+        for( size_t i = 0; i < texts__.size(); ++i ) {
+            glsfStringN( 
+                (const float*)&texts__[i].rect,
+                (const float*)&texts__[i].color,
+                texts__[i].data,
+                texts__[i].size );
         }
         glsfEnd();
     }
@@ -88,6 +367,8 @@ public:
     }
     
     float size() const { return size_; }
+    
+    GLSFfont* handle() const { return font_; }
 
 private:
     GLSFfont* font_;
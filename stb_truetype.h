@@ -24,6 +24,18 @@
 //   0.2 (2009-03-11) Fix unsigned/signed char warnings
 //   0.1 (2009-03-09) First public release
 //
+// LOCAL CHANGES (glsf)
+//
+//   This copy is patched for glsf and differs from upstream 0.3:
+//     - stbtt_FlattenCurves gives each curve as many segments as its
+//       flatness needs, counts them exactly so points are allocated once,
+//       and steps along curves by forward differencing instead of
+//       recursive midpoint subdivision. STBTT_sqrt can be overridden.
+//     - stbtt_GetGlyphBitmapBoxSubpixel and stbtt_MakeGlyphBitmapSubpixel,
+//       backported from later upstream versions, and the new
+//       stbtt_RasterizeSubpixel rasterize glyphs shifted by a fraction of
+//       a pixel. The old entry points call them with no shift.
+//
 // USAGE
 //
 //   Include this file in whatever places neeed to refer to it. In ONE C/C++
@@ -246,6 +258,11 @@ int main(int arg, char **argv)
    #define STBTT_iceil(x)    ((int) ceil(x))
    #endif
 
+   #ifndef STBTT_sqrt
+   #include <math.h>
+   #define STBTT_sqrt(x)     sqrt(x)
+   #endif
+
    // #define your own functions "STBTT_malloc" / "STBTT_free" to avoid malloc.h
    #ifndef STBTT_malloc
    #include <malloc.h>
@@ -476,6 +493,11 @@ extern unsigned char *stbtt_GetGlyphBitmap(const stbtt_fontinfo *info, float sca
 extern void stbtt_GetGlyphBitmapBox(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1);
 extern void stbtt_MakeGlyphBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, int glyph);
 
+extern void stbtt_GetGlyphBitmapBoxSubpixel(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1);
+extern void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph);
+// same as above, but the glyph is rendered offset by a fraction of a pixel
+// (shift_x,shift_y), for positioning glyphs at non-integral pen positions
+
 //extern void stbtt_get_true_bbox(stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1);
 
 // @TODO: don't expose this structure
@@ -486,6 +508,9 @@ typedef struct
 } stbtt__bitmap;
 
 extern void stbtt_Rasterize(stbtt__bitmap *result, float flatness_in_pixels, stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, int x_off, int y_off, int invert, void *userdata);
+extern void stbtt_RasterizeSubpixel(stbtt__bitmap *result, float flatness_in_pixels, stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, float shift_x, float shift_y, int x_off, int y_off, int invert, void *userdata);
+// rasterizes a shape as returned by stbtt_GetGlyphShape, e.g. one kept around
+// to render the same glyph at several sizes without parsing it again
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -1129,16 +1154,21 @@ void stbtt_FreeShape(const stbtt_fontinfo *info, stbtt_vertex *v)
 // antialiasing software rasterizer
 //
 
-void stbtt_GetGlyphBitmapBox(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1)
+void stbtt_GetGlyphBitmapBoxSubpixel(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, float shift_x, float shift_y, int *ix0, int *iy0, int *ix1, int *iy1)
 {
    int x0,y0,x1,y1;
    if (!stbtt_GetGlyphBox(font, glyph, &x0,&y0,&x1,&y1))
       x0=y0=x1=y1=0; // e.g. space character
    // now move to integral bboxes (treating pixels as little squares, what pixels get touched)?
-   if (ix0) *ix0 =  STBTT_ifloor(x0 * scale_x);
-   if (iy0) *iy0 = -STBTT_iceil (y1 * scale_y);
-   if (ix1) *ix1 =  STBTT_iceil (x1 * scale_x);
-   if (iy1) *iy1 = -STBTT_ifloor(y0 * scale_y);
+   if (ix0) *ix0 =  STBTT_ifloor(x0 * scale_x + shift_x);
+   if (iy0) *iy0 = -STBTT_iceil (y1 * scale_y - shift_y);
+   if (ix1) *ix1 =  STBTT_iceil (x1 * scale_x + shift_x);
+   if (iy1) *iy1 = -STBTT_ifloor(y0 * scale_y - shift_y);
+}
+
+void stbtt_GetGlyphBitmapBox(const stbtt_fontinfo *font, int glyph, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1)
+{
+   stbtt_GetGlyphBitmapBoxSubpixel(font, glyph, scale_x, scale_y, 0.0f, 0.0f, ix0, iy0, ix1, iy1);
 }
 
 void stbtt_GetCodepointBitmapBox(const stbtt_fontinfo *font, int codepoint, float scale_x, float scale_y, int *ix0, int *iy0, int *ix1, int *iy1)
@@ -1343,7 +1373,7 @@ typedef struct
    float x,y;
 } stbtt__point;
 
-static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcount, int windings, float scale_x, float scale_y, int off_x, int off_y, int invert, void *userdata)
+static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcount, int windings, float scale_x, float scale_y, float shift_x, float shift_y, int off_x, int off_y, int invert, void *userdata)
 {
    float y_scale_inv = invert ? -scale_y : scale_y;
    stbtt__edge *e;
@@ -1376,10 +1406,10 @@ static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcou
             e[n].invert = 1;
             a=j,b=k;
          }
-         e[n].x0 = p[a].x * scale_x;
-         e[n].y0 = p[a].y * y_scale_inv * vsubsample;
-         e[n].x1 = p[b].x * scale_x;
-         e[n].y1 = p[b].y * y_scale_inv * vsubsample;
+         e[n].x0 = p[a].x * scale_x + shift_x;
+         e[n].y0 = (p[a].y * y_scale_inv + shift_y) * vsubsample;
+         e[n].x1 = p[b].x * scale_x + shift_x;
+         e[n].y1 = (p[b].y * y_scale_inv + shift_y) * vsubsample;
          ++n;
       }
    }
@@ -1393,32 +1423,16 @@ static void stbtt__rasterize(stbtt__bitmap *result, stbtt__point *pts, int *wcou
    STBTT_free(e, userdata);
 }
 
-static void stbtt__add_point(stbtt__point *points, int n, float x, float y)
+// segments a quadratic curve needs to stay within objspace_flatness of it; each of
+// n uniform steps deviates from the curve by at most |p0 - 2*p1 + p2| / (4*n*n)
+static int stbtt__curve_segments(float x0, float y0, float x1, float y1, float x2, float y2, float objspace_flatness)
 {
-   if (!points) return; // during first pass, it's unallocated
-   points[n].x = x;
-   points[n].y = y;
-}
-
-// tesselate until threshhold p is happy... @TODO warped to compensate for non-linear stretching
-static int stbtt__tesselate_curve(stbtt__point *points, int *num_points, float x0, float y0, float x1, float y1, float x2, float y2, float objspace_flatness_squared, int n)
-{
-   // midpoint
-   float mx = (x0 + 2*x1 + x2)/4;
-   float my = (y0 + 2*y1 + y2)/4;
-   // versus directly drawn line
-   float dx = (x0+x2)/2 - mx;
-   float dy = (y0+y2)/2 - my;
-   if (n > 16) // 65536 segments on one curve better be enough!
-      return 1;
-   if (dx*dx+dy*dy > objspace_flatness_squared) { // half-pixel error allowed... need to be smaller if AA
-      stbtt__tesselate_curve(points, num_points, x0,y0, (x0+x1)/2.0f,(y0+y1)/2.0f, mx,my, objspace_flatness_squared,n+1);
-      stbtt__tesselate_curve(points, num_points, mx,my, (x1+x2)/2.0f,(y1+y2)/2.0f, x2,y2, objspace_flatness_squared,n+1);
-   } else {
-      stbtt__add_point(points, *num_points,x2,y2);
-      *num_points = *num_points+1;
-   }
-   return 1;
+   float dx = x0 - 2*x1 + x2;
+   float dy = y0 - 2*y1 + y2;
+   float n = (float) STBTT_sqrt(STBTT_sqrt(dx*dx+dy*dy) / (4*objspace_flatness));
+   if (n > 1024) // 1024 segments on one curve better be enough!
+      return 1024;
+   return n < 1 ? 1 : STBTT_iceil(n);
 }
 
 // returns number of contours
@@ -1426,61 +1440,75 @@ stbtt__point *stbtt_FlattenCurves(stbtt_vertex *vertices, int num_verts, float o
 {
    stbtt__point *points=0;
    int num_points=0;
-
-   float objspace_flatness_squared = objspace_flatness * objspace_flatness;
-   int i,n=0,start=0, pass;
-
-   // count how many "moves" there are to get the contour count
-   for (i=0; i < num_verts; ++i)
-      if (vertices[i].type == STBTT_vmove)
-         ++n;
+   float x=0,y=0;
+   int i,n=0,start=0;
+
+   // count how many "moves" there are to get the contour count, and how many
+   // points the curves flatten to, so the points are allocated up front
+   for (i=0; i < num_verts; ++i) {
+      switch (vertices[i].type) {
+         case STBTT_vmove:
+            ++n;
+            // fall through
+         case STBTT_vline:
+            ++num_points;
+            break;
+         case STBTT_vcurve:
+            num_points += stbtt__curve_segments(x,y, vertices[i].cx, vertices[i].cy, vertices[i].x, vertices[i].y, objspace_flatness);
+            break;
+      }
+      x = vertices[i].x, y = vertices[i].y;
+   }
 
    *num_contours = n;
    if (n == 0) return 0;
 
    *contour_lengths = (int *) STBTT_malloc(sizeof(**contour_lengths) * n, userdata);
-
-   if (*contour_lengths == 0) {
-      *num_contours = 0;
-      return 0;
-   }
-
-   // make two passes through the points so we don't need to realloc
-   for (pass=0; pass < 2; ++pass) {
-      float x=0,y=0;
-      if (pass == 1) {
-         points = (stbtt__point *) STBTT_malloc(num_points * sizeof(points[0]), userdata);
-         if (points == NULL) goto error;
-      }
-      num_points = 0;
-      n= -1;
-      for (i=0; i < num_verts; ++i) {
-         switch (vertices[i].type) {
-            case STBTT_vmove:
-               // start the next contour
-               if (n >= 0)
-                  (*contour_lengths)[n] = num_points - start;
-               ++n;
-               start = num_points;
-
-               x = vertices[i].x, y = vertices[i].y;
-               stbtt__add_point(points, num_points++, x,y);
-               break;
-            case STBTT_vline:
-               x = vertices[i].x, y = vertices[i].y;
-               stbtt__add_point(points, num_points++, x, y);
-               break;
-            case STBTT_vcurve:
-               stbtt__tesselate_curve(points, &num_points, x,y,
-                                        vertices[i].cx, vertices[i].cy,
-                                        vertices[i].x,  vertices[i].y,
-                                        objspace_flatness_squared, 0);
-               x = vertices[i].x, y = vertices[i].y;
-               break;
+   points = (stbtt__point *) STBTT_malloc(num_points * sizeof(points[0]), userdata);
+   if (*contour_lengths == 0 || points == 0) goto error;
+
+   // one pass, curves are stepped along by forward differencing
+   num_points = 0;
+   n = -1;
+   x = y = 0;
+   for (i=0; i < num_verts; ++i) {
+      switch (vertices[i].type) {
+         case STBTT_vmove:
+            // start the next contour
+            if (n >= 0)
+               (*contour_lengths)[n] = num_points - start;
+            ++n;
+            start = num_points;
+            // fall through
+         case STBTT_vline:
+            points[num_points].x = vertices[i].x;
+            points[num_points].y = vertices[i].y;
+            ++num_points;
+            break;
+         case STBTT_vcurve: {
+            float cx = vertices[i].cx, cy = vertices[i].cy;
+            int k, segments = stbtt__curve_segments(x,y, cx,cy, vertices[i].x, vertices[i].y, objspace_flatness);
+            float t = 1.0f / segments;
+            float ddx = (x - 2*cx + vertices[i].x) * t*t, ddy = (y - 2*cy + vertices[i].y) * t*t;
+            float dx = 2*(cx - x)*t + ddx, dy = 2*(cy - y)*t + ddy;
+            float px = x, py = y;
+            for (k=1; k < segments; ++k) {
+               px += dx, py += dy;
+               dx += 2*ddx, dy += 2*ddy;
+               points[num_points].x = px;
+               points[num_points].y = py;
+               ++num_points;
+            }
+            // end exactly on the curve's end point
+            points[num_points].x = vertices[i].x;
+            points[num_points].y = vertices[i].y;
+            ++num_points;
+            break;
          }
       }
-      (*contour_lengths)[n] = num_points - start;
+      x = vertices[i].x, y = vertices[i].y;
    }
+   (*contour_lengths)[n] = num_points - start;
 
    return points;
 error:
@@ -1491,18 +1519,23 @@ error:
    return NULL;
 }
 
-void stbtt_Rasterize(stbtt__bitmap *result, float flatness_in_pixels, stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, int x_off, int y_off, int invert, void *userdata)
+void stbtt_RasterizeSubpixel(stbtt__bitmap *result, float flatness_in_pixels, stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, float shift_x, float shift_y, int x_off, int y_off, int invert, void *userdata)
 {
    float scale = scale_x > scale_y ? scale_y : scale_x;
    int winding_count, *winding_lengths;
    stbtt__point *windings = stbtt_FlattenCurves(vertices, num_verts, flatness_in_pixels / scale, &winding_lengths, &winding_count, userdata);
    if (windings) {
-      stbtt__rasterize(result, windings, winding_lengths, winding_count, scale_x, scale_y, x_off, y_off, invert, userdata);
+      stbtt__rasterize(result, windings, winding_lengths, winding_count, scale_x, scale_y, shift_x, shift_y, x_off, y_off, invert, userdata);
       STBTT_free(winding_lengths, userdata);
       STBTT_free(windings, userdata);
    }
 }
 
+void stbtt_Rasterize(stbtt__bitmap *result, float flatness_in_pixels, stbtt_vertex *vertices, int num_verts, float scale_x, float scale_y, int x_off, int y_off, int invert, void *userdata)
+{
+   stbtt_RasterizeSubpixel(result, flatness_in_pixels, vertices, num_verts, scale_x, scale_y, 0.0f, 0.0f, x_off, y_off, invert, userdata);
+}
+
 void stbtt_FreeBitmap(unsigned char *bitmap, void *userdata)
 {
    STBTT_free(bitmap, userdata);
@@ -1545,25 +1578,30 @@ unsigned char *stbtt_GetGlyphBitmap(const stbtt_fontinfo *info, float scale_x, f
    return gbm.pixels;
 }   
 
-void stbtt_MakeGlyphBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, int glyph)
+void stbtt_MakeGlyphBitmapSubpixel(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, float shift_x, float shift_y, int glyph)
 {
    int ix0,iy0;
    stbtt_vertex *vertices;   
    int num_verts = stbtt_GetGlyphShape(info, glyph, &vertices);
    stbtt__bitmap gbm;   
 
-   stbtt_GetGlyphBitmapBox(info, glyph, scale_x, scale_y, &ix0,&iy0,0,0);
+   stbtt_GetGlyphBitmapBoxSubpixel(info, glyph, scale_x, scale_y, shift_x, shift_y, &ix0,&iy0,0,0);
    gbm.pixels = output;
    gbm.w = out_w;
    gbm.h = out_h;
    gbm.stride = out_stride;
 
    if (gbm.w && gbm.h)
-      stbtt_Rasterize(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, ix0,iy0, 1, info->userdata);
+      stbtt_RasterizeSubpixel(&gbm, 0.35f, vertices, num_verts, scale_x, scale_y, shift_x, shift_y, ix0,iy0, 1, info->userdata);
 
    STBTT_free(vertices, info->userdata);
 }
 
+void stbtt_MakeGlyphBitmap(const stbtt_fontinfo *info, unsigned char *output, int out_w, int out_h, int out_stride, float scale_x, float scale_y, int glyph)
+{
+   stbtt_MakeGlyphBitmapSubpixel(info, output, out_w, out_h, out_stride, scale_x, scale_y, 0.0f, 0.0f, glyph);
+}
+
 unsigned char *stbtt_GetCodepointBitmap(const stbtt_fontinfo *info, float scale_x, float scale_y, int codepoint, int *width, int *height, int *xoff, int *yoff)
 {
    return stbtt_GetGlyphBitmap(info, scale_x, scale_y, stbtt_FindGlyphIndex(info,codepoint), width,height,xoff,yoff);
@@ -0,0 +1,770 @@
+/**
+ * Headless checks for glsf. Builds without GL and draws into a recorder
+ * backend, comparing what incremental and cached paths draw with a fresh
+ * layout of the same text:
+ *
+ *   cc -O2 -DGLSF_NO_GL test/test.c -o glsf_test -lm -lpthread
+ *   ./glsf_test <font> [filter]
+ *
+ * Prints every failed check and exits non-zero if any failed.
+ */
+#ifndef GLSF_NO_GL
+#define GLSF_NO_GL
+#endif
+#include "../glsf.h"
+
+#define TEST_CHECK(cond) testCheck((cond) != 0, #cond, __FILE__, __LINE__)
+
+static const char* _test_filter = NULL;
+static int _test_checks = 0;
+static int _test_failures = 0;
+
+static const char* _test_words[] = {
+    "the ", "quick ", "brown ", "fox ", "jumps\n", "over ", "lazy ", "dog. ",
+    "\n", "supercalifragilisticexpialidocious ", "0123456789 ", "a"
+};
+
+/**
+ * @fn testCheck
+ * @brief Counts a check, printing where it failed. Returns whether it held.
+ */
+static int testCheck( int ok, const char* expr, const char* file, int line )
+{
+    _test_checks++;
+    if(!ok) {
+        fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expr);
+        _test_failures++;
+    }
+    return ok;
+}
+
+/**
+ * @fn testEnabled
+ * @brief Whether a test matches the filter given on command line.
+ */
+static int testEnabled( const char* name )
+{
+    return !_test_filter || strstr(name, _test_filter) != NULL;
+}
+
+/**
+ * @fn testCreateFont
+ * @brief Creates a font drawing into a recorder, see GLSF_RECORD_UPLOADS
+ *        for flags.
+ */
+static GLSFfont* testCreateFont( const char* filename, float size,
+                                 GLSFrecorder* recorder, uint32_t flags )
+{
+    GLSFfont* font = glsfCreateFont(filename, size, "");
+    if(!TEST_CHECK(font != NULL))
+        return NULL;
+
+    glsfInitRecorder(recorder, flags);
+    GLSFbackend backend = glsfRecorderBackend(recorder);
+    glsfSetBackend(font, &backend);
+    return font;
+}
+
+/**
+ * @fn testRandomText
+ * @brief Fills text with length bytes of random words, some newlines and
+ *        some words wider than the lines they are wrapped at.
+ */
+static void testRandomText( char* text, size_t length )
+{
+    size_t n = 0;
+    while(n < length) {
+        const char* word = _test_words[rand() % (sizeof(_test_words) / sizeof(_test_words[0]))];
+        size_t size = strlen(word);
+        if(size > length - n)
+            size = length - n;
+        memcpy(text + n, word, size);
+        n += size;
+    }
+}
+
+/**
+ * @fn testSameInstance
+ * @brief Whether an instance drawn moved by offset is the expected one.
+ *        Positions may differ by float rounding of the sums that made
+ *        them, in another order.
+ */
+static int testSameInstance( const GLSFinstance* drawn, const float offset[2],
+                             const GLSFinstance* expected )
+{
+    return fabsf(drawn->x + offset[0] - expected->x) < 1e-3f &&
+           fabsf(drawn->y + offset[1] - expected->y) < 1e-3f &&
+           drawn->s == expected->s && drawn->t == expected->t &&
+           drawn->w == expected->w && drawn->h == expected->h &&
+           memcmp(drawn->color, expected->color, 4) == 0;
+}
+
+/**
+ * @fn testCompareDraws
+ * @brief Checks that the recorded draws, in order, show count instances
+ *        of expected. Returns whether they do.
+ */
+static int testCompareDraws( const GLSFrecorder* recorder,
+                             const GLSFinstance* expected, size_t count )
+{
+    size_t n = 0, i, j;
+    for(i = 0; i < recorder->num_submits; ++i) {
+        const GLSFsubmit* submit = &recorder->submits[i];
+        for(j = 0; j < submit->count; ++j, ++n) {
+            if(n >= count || !testSameInstance(&recorder->instances[submit->offset + j],
+                                               submit->translation, &expected[n]))
+                return TEST_CHECK(n < count && !"drawn instance differs from full layout");
+        }
+    }
+    return TEST_CHECK(n == count);
+}
+
+/**
+ * @fn testFullLayout
+ * @brief Lays out a whole text at once with a fresh uncached batch.
+ */
+static void testFullLayout( GLSFbatch* batch, GLSFfont* font, float x, float y,
+                            float width, const float color[4], const char* text,
+                            size_t length )
+{
+    float rect[4] = { x, y, width, 0 };
+    glsfInitBatch(batch);
+    glsfBatchBegin(batch, font);
+    glsfBatchStringN(batch, rect, color, text, length);
+}
+
+/**
+ * @fn testDocument
+ * @brief Scrolls a document over its text, then checks the lines it draws
+ *        at each position against one layout of the whole text.
+ */
+static void testDocument( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 18, &recorder, GLSF_RECORD_DRAWS);
+    if(!font)
+        return;
+
+    size_t length = 20000;
+    char* text = (char*)malloc(length);
+    srand(1);
+    testRandomText(text, length);
+
+    GLSFdocument document;
+    float color[4] = { 1, 0.5f, 0.25f, 1 }, view[4] = { 5, 7, 300, 200 };
+    glsfInitDocument(&document, font, 300);
+    glsfAppendDocument(&document, text, length);
+
+    // Glyphs load while scrolling, changing the line height under it.
+    float scroll;
+    glsfIndexDocument(&document, (size_t)-1);
+    for(scroll = 0; scroll < document.num_lines * 30.0f; scroll += 150)
+        glsfDrawDocument(&document, view, color, scroll);
+    float bottom = document.num_lines * (float)glsfLoadCount(&font->cache->height);
+
+    GLSFbatch full;
+    testFullLayout(&full, font, view[0], view[1], 300, color, text, length);
+
+    // The first line drawn is found by where its first glyph lands.
+    for(scroll = 0; scroll < bottom; scroll += 1234.5f) {
+        glsfClearRecorder(&recorder);
+        glsfDrawDocument(&document, view, color, scroll);
+        if(!TEST_CHECK(recorder.num_submits == 1))
+            continue;
+
+        const GLSFsubmit* submit = &recorder.submits[0];
+        float offset[2] = { submit->translation[0], submit->translation[1] + scroll };
+        size_t first = 0;
+        while(first < full.num_instances &&
+              !testSameInstance(&recorder.instances[submit->offset], offset,
+                                &full.instances[first]))
+            first++;
+        if(!TEST_CHECK(first + submit->count <= full.num_instances))
+            continue;
+
+        size_t i;
+        for(i = 0; i < submit->count; ++i)
+            if(!testSameInstance(&recorder.instances[submit->offset + i], offset,
+                                 &full.instances[first + i]))
+                break;
+        TEST_CHECK(i == submit->count);
+    }
+
+    glsfFreeBatch(&full);
+    glsfFreeDocument(&document);
+    free(text);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * @fn testLayoutCache
+ * @brief Draws the same strings for some frames with and without a layout
+ *        cache, moving and recoloring some, and checks both draw the same.
+ */
+static void testLayoutCache( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 16, &recorder, GLSF_RECORD_DRAWS);
+    if(!font)
+        return;
+
+    const char* strings[] = {
+        "Health 100", "Ammo 30/90", "The quick brown fox jumps over the lazy dog.",
+        "wrapped at a narrow width, over a few lines", "Health 100"
+    };
+    GLSFbatch cached, uncached;
+    glsfInitBatch(&cached);
+    glsfInitBatch(&uncached);
+    glsfBatchCache(&cached, 2);
+
+    // Glyphs loading change the baseline of what was laid out before
+    // them, load them all first.
+    float rect[4] = { 0, 0, 1000, 0 }, white[4] = { 1, 1, 1, 1 };
+    glsfBatchBegin(&uncached, font);
+    size_t i;
+    for(i = 0; i < 5; ++i)
+        glsfBatchString(&uncached, rect, white, strings[i]);
+    uncached.num_instances = 0;
+
+    uint32_t phases;
+    for(phases = 1; phases <= 4; phases *= 4) {
+        glsfSetSubpixel(font, phases);
+
+        int32_t frame;
+        for(frame = 0; frame < 8; ++frame) {
+            glsfClearRecorder(&recorder);
+            glsfBatchBegin(&uncached, font);
+            for(i = 0; i < 5; ++i) {
+                float rect[4] = { 10.25f + (frame & 2) * 3, 20.0f * i + (frame & 4),
+                                  i == 3 ? 90 : 1000, 0 };
+                float color[4] = { 1, 1, i == 4 && (frame & 1) ? 0 : 1, 1 };
+                glsfBatchStringN(&uncached, rect, color, strings[i], (size_t)-1);
+            }
+
+            size_t count = uncached.num_instances;
+            GLSFinstance* expected = (GLSFinstance*)malloc(sizeof(GLSFinstance) * (count + 1));
+            memcpy(expected, uncached.instances, sizeof(GLSFinstance) * count);
+            glsfBatchEnd(&uncached);
+
+            glsfClearRecorder(&recorder);
+            glsfBatchBegin(&cached, font);
+            for(i = 0; i < 5; ++i) {
+                float rect[4] = { 10.25f + (frame & 2) * 3, 20.0f * i + (frame & 4),
+                                  i == 3 ? 90 : 1000, 0 };
+                float color[4] = { 1, 1, i == 4 && (frame & 1) ? 0 : 1, 1 };
+                glsfBatchStringN(&cached, rect, color, strings[i], (size_t)-1);
+            }
+            glsfBatchEnd(&cached);
+            testCompareDraws(&recorder, expected, count);
+            free(expected);
+        }
+    }
+
+#ifndef GLSF_NO_STATS
+    GLSFstats stats;
+    glsfGetStats(font, &stats);
+    TEST_CHECK(stats.layouts_reused > 0);
+
+    // Counted even when everything is culled and nothing drawn.
+    float clip[4] = { 2000, 0, 10, 100 };
+    glsfResetStats(font);
+    glsfBatchBegin(&uncached, font);
+    glsfBatchClip(&uncached, clip);
+    glsfBatchString(&uncached, rect, white, strings[0]);
+    glsfBatchEnd(&uncached);
+    glsfBatchClip(&uncached, NULL);
+    glsfGetStats(font, &stats);
+    TEST_CHECK(stats.glyphs_culled > 0 && stats.draw_calls == 0);
+#endif
+
+    // Strings with the same hash are told apart by their bytes. Collide
+    // by filing the layout of one under the hash of the other, with
+    // both strings' glyphs loaded first.
+    glsfClearRecorder(&recorder);
+    glsfBatchBegin(&uncached, font);
+    glsfBatchString(&uncached, rect, white, "Ammo 30/90");
+    uncached.num_instances = 0;
+    glsfBatchString(&uncached, rect, white, "Ammo 30/91");
+    size_t count = uncached.num_instances;
+    GLSFinstance* expected = (GLSFinstance*)malloc(sizeof(GLSFinstance) * count);
+    memcpy(expected, uncached.instances, sizeof(GLSFinstance) * count);
+    glsfBatchEnd(&uncached);
+
+    GLSFbatch forged;
+    glsfInitBatch(&forged);
+    glsfBatchCache(&forged, 2);
+    glsfBatchBegin(&forged, font);
+    glsfBatchString(&forged, rect, white, "Ammo 30/90");
+    glsfBatchEnd(&forged);
+    for(i = 0; i < forged.max_layouts && !forged.layouts[i].used; ++i);
+    TEST_CHECK(i < forged.max_layouts);
+    GLSFlayout layout = forged.layouts[i];
+    size_t length = (size_t)-1;
+    layout.hash = glsfHashString("Ammo 30/91", &length);
+    memset(&forged.layouts[i], 0, sizeof(GLSFlayout));
+    *glsfFindLayout(&forged, &layout, forged.bytes + layout.offset) = layout;
+
+    glsfClearRecorder(&recorder);
+    glsfBatchBegin(&forged, font);
+    glsfBatchString(&forged, rect, white, "Ammo 30/91");
+    glsfBatchEnd(&forged);
+    testCompareDraws(&recorder, expected, count);
+    free(expected);
+
+    glsfFreeBatch(&forged);
+    glsfFreeBatch(&cached);
+    glsfFreeBatch(&uncached);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * @fn testConsole
+ * @brief Appends lines of short glyphs, then lines of tall ones, to a
+ *        console of a new font and to one of a font that has the tall
+ *        glyphs loaded already, and checks both draw glyphs in the same
+ *        places.
+ */
+static void testConsole( const char* filename )
+{
+    GLSFrecorder recorders[2];
+    GLSFfont* fonts[2] = {
+        testCreateFont(filename, 20, &recorders[0], GLSF_RECORD_DRAWS),
+        testCreateFont(filename, 20, &recorders[1], GLSF_RECORD_DRAWS)
+    };
+    if(!fonts[0] || !fonts[1])
+        return;
+
+    const char* lines[] = {
+        "some warm ocean waves", "an excess of sea,\nsome more", 
+        "The quick (brown) fox jumps over the {lazy} dog|", "some warm ocean waves"
+    };
+    float color[4] = { 1, 1, 1, 1 }, view[4] = { 10, 20, 400, 300 };
+    float rect[4] = { 0, 0, 1000, 0 };
+    glsfBatchBegin(&fonts[1]->batch, fonts[1]);
+    glsfBatchString(&fonts[1]->batch, rect, color, lines[2]);
+    fonts[1]->batch.num_instances = 0;
+
+    GLSFconsole consoles[2];
+    size_t i, j;
+    for(i = 0; i < 2; ++i) {
+        glsfInitConsole(&consoles[i], fonts[i], 150, 16, 1024);
+        for(j = 0; j < 4; ++j)
+            TEST_CHECK(glsfAppendConsole(&consoles[i], color, lines[j]));
+        glsfDrawConsole(&consoles[i], view);
+    }
+
+    // Atlases are packed in another order, only positions match.
+    if(TEST_CHECK(recorders[0].num_submits == 1 && recorders[1].num_submits == 1)) {
+        const GLSFsubmit* submits[2] = { &recorders[0].submits[0], &recorders[1].submits[0] };
+        const GLSFinstance* a = recorders[0].instances + submits[0]->offset;
+        const GLSFinstance* b = recorders[1].instances + submits[1]->offset;
+        size_t count = submits[0]->count;
+        TEST_CHECK(count > 0 && count == submits[1]->count);
+        for(j = 0; j < count && j < submits[1]->count; ++j) {
+            if(a[j].x + submits[0]->translation[0] != b[j].x + submits[1]->translation[0] ||
+               a[j].y + submits[0]->translation[1] != b[j].y + submits[1]->translation[1] || 
+               a[j].w != b[j].w || a[j].h != b[j].h)
+                break;
+        }
+        TEST_CHECK(j == count);
+    }
+
+    for(i = 0; i < 2; ++i) {
+        glsfFreeConsole(&consoles[i]);
+        glsfDestroyFont(fonts[i]);
+        glsfFreeRecorder(&recorders[i]);
+    }
+}
+
+/**
+ * @fn testEditor
+ * @brief Makes random edits to the text of an editor, at first without
+ *        glyphs reaching above x-height or below the baseline, and checks
+ *        what it draws against one layout of the whole text.
+ */
+static void testEditor( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 16, &recorder, GLSF_RECORD_DRAWS);
+    if(!font)
+        return;
+
+    const char* words[] = {
+        "some ", "warm ", "ocean ", "waves ", "an ", "excess ", "\n", "sea", 
+        "The ", "quick ", "jumps\n", "(brackets) ", "Wide{}|Words ", "y"
+    };
+    size_t max_length = 1 << 16, length = 0;
+    char* text = (char*)malloc(max_length);
+    float color[4] = { 1, 1, 1, 1 };
+
+    GLSFeditor editor;
+    glsfInitEditor(&editor, font, 220, color);
+
+    srand(3);
+    int32_t edit;
+    for(edit = 0; edit < 3000; ++edit) {
+        size_t pos = rand() % (length + 1);
+        size_t remove = rand() % 4 == 0 ? rand() % 12 : rand() % 2;
+        if(remove > length - pos)
+            remove = length - pos;
+        const char* word = words[rand() % (edit < 1000 ? 8 : 14)];
+        size_t size = strlen(word);
+        if(length - remove + size > max_length)
+            break;
+
+        memmove(text + pos + size, text + pos + remove, length - pos - remove);
+        memcpy(text + pos, word, size);
+        length = length - remove + size;
+        if(!TEST_CHECK(glsfEditText(&editor, pos, remove, word, size)))
+            break;
+        if(!TEST_CHECK(editor.length == length && memcmp(editor.text, text, length) == 0))
+            break;
+
+        if(edit % 100 == 99) {
+            GLSFbatch full;
+            glsfClearRecorder(&recorder);
+            glsfDrawEditor(&editor, 3, 4);
+            testFullLayout(&full, font, 3, 4, 220, color, text, length);
+            testCompareDraws(&recorder, full.instances, full.num_instances);
+            glsfFreeBatch(&full);
+        }
+    }
+
+    glsfFreeEditor(&editor);
+    free(text);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * @fn testAtlas
+ * @brief Loads large glyphs until the atlas is full, syncing now and then,
+ *        and checks every glyph is inside it and the texture built from
+ *        the uploads is the atlas.
+ */
+static void testAtlas( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 500, &recorder, GLSF_RECORD_UPLOADS);
+    if(!font)
+        return;
+
+    GLSFcache* cache = font->cache;
+    uint32_t codepoint;
+    for(codepoint = 33; codepoint < 0x2000 && !cache->atlas_full; ++codepoint) {
+        glsfGetGlyph(font, codepoint);
+        if(codepoint % 16 == 0)
+            TEST_CHECK(glsfSyncFont(font));
+    }
+    TEST_CHECK(glsfSyncFont(font));
+    TEST_CHECK(cache->atlas_full);
+    TEST_CHECK(cache->atlas_height <= GLSF_MAX_ATLAS_HEIGHT);
+
+    // The glyph that did not fit is blank, found again without loading.
+    const GLSFglyphrecord* blank = glsfFindGlyph(font, codepoint - 1);
+    uint32_t num_glyphs = cache->num_glyphs;
+    TEST_CHECK(blank && blank->w == 0 && blank->h == 0 && blank->advance > 0);
+    TEST_CHECK(glsfGetGlyph(font, codepoint - 1) == blank && cache->num_glyphs == num_glyphs);
+
+    uint32_t i;
+    for(i = 0; i < cache->num_glyphs; ++i) {
+        const GLSFglyphrecord* glyph = glsfGlyphRecord(cache, i);
+        if(glyph->s + glyph->w > cache->atlas_width || glyph->t + glyph->h > cache->atlas_height)
+            break;
+    }
+    TEST_CHECK(i == cache->num_glyphs);
+
+    // A new texture starts blank.
+    size_t size = (size_t)cache->atlas_width * cache->atlas_height;
+    uint8_t* texture = (uint8_t*)calloc(size, 1);
+    uint32_t name = 0;
+    for(i = 0; i < recorder.num_uploads; ++i) {
+        const GLSFupload* upload = &recorder.uploads[i];
+        if(upload->texture != name) {
+            memset(texture, 0, size);
+            name = upload->texture;
+        }
+        int32_t row;
+        for(row = 0; row < upload->height; ++row)
+            memcpy(texture + (size_t)(upload->y + row) * cache->atlas_width + upload->x,
+                   recorder.pixels + upload->offset + (size_t)row * upload->width, 
+                   upload->width);
+    }
+    TEST_CHECK(name == font->texture.name && memcmp(texture, cache->pixels, size) == 0);
+
+    free(texture);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * Raster events seen by testTrace, whose callbacks load glyphs.
+ */
+typedef struct {
+    GLSFfont* font;
+    int32_t   depth, begun, ended, ordered;
+    double    begin;
+} TESTtrace;
+
+static void testTraceBegin( void* user, const GLSFtraceevent* event )
+{
+    TESTtrace* trace = (TESTtrace*)user;
+    if(strcmp(event->name, "glsfRasterGlyph") != 0)
+        return;
+    trace->begun++;
+    if(trace->depth++ == 0) {
+        trace->begin = event->time;
+        glsfGetGlyph(trace->font, event->codepoint + 1);
+    }
+    trace->depth--;
+}
+
+static void testTraceEnd( void* user, const GLSFtraceevent* event )
+{
+    TESTtrace* trace = (TESTtrace*)user;
+    if(strcmp(event->name, "glsfRasterGlyph") != 0)
+        return;
+    trace->ended++;
+    trace->ordered += event->time >= trace->begin;
+}
+
+/**
+ * @fn testTrace
+ * @brief Loads glyphs with trace callbacks that load more glyphs, which
+ *        hangs if they are called holding the cache's lock.
+ */
+static void testTrace( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 24, &recorder, 0);
+    if(!font)
+        return;
+
+    TESTtrace trace;
+    memset(&trace, 0, sizeof(TESTtrace));
+    trace.font = font;
+    GLSFtrace callbacks = { &trace, testTraceBegin, testTraceEnd };
+    glsfSetTrace(font, &callbacks);
+
+    const char* letters = "acegikmoqsuwy";
+    size_t i;
+    for(i = 0; letters[i]; ++i)
+        glsfGetGlyph(font, (uint32_t)letters[i]);
+#ifndef GLSF_NO_TRACE
+    TEST_CHECK(glsfFindGlyph(font, 'b') != NULL && glsfFindGlyph(font, 'z') != NULL);
+    TEST_CHECK(trace.begun == 26 && trace.ended == 26 && trace.ordered == 26);
+#endif
+
+    glsfSetTrace(font, NULL);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * @fn testStats
+ * @brief Checks resetting one font's counters leaves those of the cache it
+ *        shares with another font, which glsfResetCacheStats zeroes.
+ */
+static void testStats( const char* filename )
+{
+    GLSFrecorder recorder;
+    GLSFfont* font = testCreateFont(filename, 20, &recorder, 0);
+    if(!font)
+        return;
+    GLSFfont* shared = glsfCreateFontShared(font);
+    TEST_CHECK(shared != NULL);
+
+    GLSFstats stats;
+    glsfGetGlyph(font, 'A');
+    glsfResetStats(font);
+    glsfGetStats(shared, &stats);
+#ifndef GLSF_NO_STATS
+    TEST_CHECK(stats.glyphs_rasterized == 1);
+#endif
+    glsfResetCacheStats(font);
+    glsfGetStats(shared, &stats);
+    TEST_CHECK(stats.glyphs_rasterized == 0 && stats.raster_time == 0);
+
+    glsfDestroyFont(shared);
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+}
+
+/**
+ * Allocations made through testAlloc and friends, and how many are live.
+ */
+typedef struct {
+    size_t allocs, live;
+} TESTallocs;
+
+static void* testAlloc( void* user, size_t size )
+{
+    TESTallocs* allocs = (TESTallocs*)user;
+    void* ptr = malloc(size);
+    if(ptr) {
+        allocs->allocs++;
+        allocs->live++;
+    }
+    return ptr;
+}
+
+static void* testRealloc( void* user, void* ptr, size_t size )
+{
+    TESTallocs* allocs = (TESTallocs*)user;
+    void* new_ptr = realloc(ptr, size);
+    if(new_ptr && !ptr) {
+        allocs->allocs++;
+        allocs->live++;
+    }
+    return new_ptr;
+}
+
+static void testFree( void* user, void* ptr )
+{
+    ((TESTallocs*)user)->live--;
+    free(ptr);
+}
+
+/**
+ * @fn testAllocator
+ * @brief Draws, records, loads a bitmap and calls stbtt on the face with
+ *        counting hooks, and checks all of it went through them.
+ */
+static void testAllocator( const char* filename )
+{
+    TESTallocs allocs = { 0, 0 };
+    GLSFallocator allocator = { &allocs, testAlloc, testRealloc, testFree };
+    GLSFfont* font = glsfCreateFontEx(filename, 16, "", &allocator);
+    if(!TEST_CHECK(font != NULL))
+        return;
+
+    GLSFrecorder recorder;
+    glsfInitRecorder(&recorder, GLSF_RECORD_UPLOADS | GLSF_RECORD_DRAWS);
+    recorder.allocator = allocator;
+    GLSFbackend backend = glsfRecorderBackend(&recorder);
+    glsfSetBackend(font, &backend);
+
+    float rect[4] = { 0, 0, 500, 0 }, white[4] = { 1, 1, 1, 1 };
+    glsfDrawString(font, rect, white, "Allocated");
+    TEST_CHECK(recorder.num_uploads > 0 && recorder.num_submits > 0);
+
+    GLSFglyph glyph;
+    GLSFbitmap bitmap;
+    TEST_CHECK(glsfLoadGlyph(font, 'g', &glyph));
+    TEST_CHECK(glsfLoadBitmap(font, &glyph, &bitmap));
+    glsfFreeBitmap(font, &bitmap);
+
+    size_t count = allocs.allocs;
+    const stbtt_fontinfo* info = &font->cache->face->info;
+    int32_t width, height;
+    uint8_t* pixels = stbtt_GetCodepointBitmap(info, 0.05f, 0.05f, 'g', 
+                                               &width, &height, NULL, NULL);
+    TEST_CHECK(pixels != NULL && allocs.allocs > count);
+    stbtt_FreeBitmap(pixels, info->userdata);
+
+    glsfDestroyFont(font);
+    glsfFreeRecorder(&recorder);
+    TEST_CHECK(allocs.live == 0);
+}
+
+/**
+ * @fn testExpandInstances
+ * @brief Checks glsfExpandInstances against vertices made one by one from
+ *        glsfInstanceQuad, to the bit.
+ */
+static void testExpandInstances()
+{
+    size_t count = 1000, i;
+    GLSFinstance* instances = (GLSFinstance*)malloc(sizeof(GLSFinstance) * count);
+    GLSFvertex* vertices = (GLSFvertex*)malloc(sizeof(GLSFvertex) * count * 6);
+    GLSFvertex* expected = (GLSFvertex*)malloc(sizeof(GLSFvertex) * count * 6);
+
+    srand(2);
+    for(i = 0; i < count; ++i) {
+        GLSFinstance* instance = &instances[i];
+        instance->x = (float)(rand() % 4000 - 1000) + (float)(rand() % 4) * 0.25f;
+        instance->y = (float)(rand() % 4000 - 1000) * 1.5f;
+        instance->s = (uint16_t)(rand() % 4096);
+        instance->t = (uint16_t)(rand() % 8192);
+        instance->w = (uint16_t)(rand() % 200);
+        instance->h = (uint16_t)(rand() % 200);
+        instance->color[0] = (uint8_t)rand();
+        instance->color[1] = (uint8_t)rand();
+        instance->color[2] = (uint8_t)rand();
+        instance->color[3] = (uint8_t)rand();
+    }
+
+    GLSFtexture texture = { 1, 4096, 3000 };
+    GLSFdraw draw;
+    draw.texture = &texture;
+    draw.instances = instances;
+    draw.num_instances = count;
+    draw.offset[0] = 12.5f;
+    draw.offset[1] = -3.0f;
+
+    // Two triangles, bottom left, top left, bottom right and top left,
+    // top right, bottom right.
+    for(i = 0; i < count; ++i) {
+        GLSFquad quad;
+        glsfInstanceQuad(&draw, &instances[i], &quad);
+        float corners[4][4] = {
+            { quad.x0, quad.y1, quad.u0, quad.v1 }, { quad.x0, quad.y0, quad.u0, quad.v0 },
+            { quad.x1, quad.y1, quad.u1, quad.v1 }, { quad.x1, quad.y0, quad.u1, quad.v0 }
+        };
+        const int32_t order[6] = { 0, 1, 2, 1, 3, 2 };
+        int32_t k;
+        for(k = 0; k < 6; ++k) {
+            GLSFvertex* vertex = &expected[i * 6 + k];
+            vertex->x = corners[order[k]][0];
+            vertex->y = corners[order[k]][1];
+            vertex->u = corners[order[k]][2];
+            vertex->v = corners[order[k]][3];
+            vertex->r = quad.color[0] * (1.0f / 255.0f);
+            vertex->g = quad.color[1] * (1.0f / 255.0f);
+            vertex->b = quad.color[2] * (1.0f / 255.0f);
+            vertex->a = quad.color[3] * (1.0f / 255.0f);
+        }
+    }
+
+    glsfExpandInstances(&draw, vertices);
+    TEST_CHECK(memcmp(vertices, expected, sizeof(GLSFvertex) * count * 6) == 0);
+
+    free(instances);
+    free(vertices);
+    free(expected);
+}
+
+int main( int argc, char* argv[] )
+{
+    if( argc < 2 ) {
+        printf("Usage: glsf_test <font> [filter]\n");
+        return EXIT_FAILURE;
+    }
+
+    const char* filename = argv[1];
+    _test_filter = argc > 2 ? argv[2] : NULL;
+
+    if(testEnabled("document"))
+        testDocument(filename);
+    if(testEnabled("cache"))
+        testLayoutCache(filename);
+    if(testEnabled("console"))
+        testConsole(filename);
+    if(testEnabled("editor"))
+        testEditor(filename);
+    if(testEnabled("atlas"))
+        testAtlas(filename);
+    if(testEnabled("trace"))
+        testTrace(filename);
+    if(testEnabled("stats"))
+        testStats(filename);
+    if(testEnabled("allocator"))
+        testAllocator(filename);
+    if(testEnabled("vertices"))
+        testExpandInstances();
+
+    printf("%d checks, %d failed\n", _test_checks, _test_failures);
+    return _test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}